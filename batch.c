@@ -0,0 +1,423 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "decoder.h"
+#include "threshold.h"
+
+/* Number of bit planes for the counters (enough for block_weight <= 65535),
+ * only the first 8 are used when block_weight <= MAX_NARROW_WEIGHT. */
+#define COUNTER_PLANES 16
+/* Number of bit planes for the syndrome weights, only the first 17 are used
+ * when block_length <= 65536. */
+#define WEIGHT_PLANES 32
+/* Number of positions accumulated in registers by lanes_multiply_columns. */
+#define LANES_BLOCK 8
+
+/* Carry-save adder on lanes: (h, l) = a + b + c. */
+#define CSA(h, l, a, b, c)                                                     \
+    do {                                                                       \
+        lanes_t a_ = (a), b_ = (b), c_ = (c);                                  \
+        lanes_t u_ = a_ ^ b_;                                                  \
+        (h) = (a_ & b_) | (u_ & c_);                                           \
+        (l) = u_ ^ c_;                                                         \
+    } while (0)
+
+/* Add 'in' (of weight 2^first) to the vertical counters stored in the
+ * 'n_planes' planes of 'planes'. */
+#define ADD_LANES(planes, n_planes, first, in)                                 \
+    do {                                                                       \
+        lanes_t c_ = (in);                                                     \
+        for (int p_ = (first); p_ < (n_planes); ++p_) {                        \
+            lanes_t t_ = (planes)[p_] & c_;                                    \
+            (planes)[p_] ^= c_;                                                \
+            c_ = t_;                                                           \
+        }                                                                      \
+    } while (0)
+
+static int lanes_any(const lanes_t *v);
+static int lane_get(const lanes_t *v, int b);
+static void lane_flip(lanes_t *v, int b);
+static unsigned lane_value(const lanes_t *planes, int n_planes, int b);
+static void lanes_weight(const lanes_t *restrict v, index_t length,
+                         index_t *restrict weights);
+static void lanes_flip_columns(batch_decoder_t dec, index_t k, index_t j,
+                               const lanes_t *mask);
+static void lanes_multiply_columns(batch_decoder_t dec, index_t k,
+                                   lanes_t *restrict v);
+static void narrow_active(batch_decoder_t dec, lanes_t *active);
+static void compute_flips(batch_decoder_t dec, index_t k,
+                          const lanes_t *restrict threshold,
+                          const lanes_t *active);
+static void expire_flips(batch_decoder_t dec, const lanes_t *active);
+
+static int lanes_any(const lanes_t *v) {
+    word_t any = 0;
+    for (int w = 0; w < BATCH_WORDS; ++w) {
+        any |= (*v)[w];
+    }
+    return any != 0;
+}
+
+static int lane_get(const lanes_t *v, int b) {
+    return ((*v)[b / WORD_BITS] >> (b % WORD_BITS)) & 1;
+}
+
+static void lane_flip(lanes_t *v, int b) {
+    (*v)[b / WORD_BITS] ^= (word_t)1 << (b % WORD_BITS);
+}
+
+/* Value of lane 'b' of a number stored as bit planes. */
+static unsigned lane_value(const lanes_t *planes, int n_planes, int b) {
+    unsigned value = 0;
+    for (int p = 0; p < n_planes; ++p) {
+        value |= lane_get(&planes[p], b) << p;
+    }
+    return value;
+}
+
+/* Hamming weight of each lane of 'v', using 'n_planes' planes. */
+ALWAYS_INLINE void lanes_weight_body(const lanes_t *restrict v, index_t length,
+                                     index_t *restrict weights, int n_planes) {
+    lanes_t planes[WEIGHT_PLANES] = {0};
+    lanes_t twos_a, twos_b, fours_a, fours_b, eights;
+
+    index_t i;
+    for (i = 0; i + 8 <= length; i += 8) {
+        CSA(twos_a, planes[0], planes[0], v[i], v[i + 1]);
+        CSA(twos_b, planes[0], planes[0], v[i + 2], v[i + 3]);
+        CSA(fours_a, planes[1], planes[1], twos_a, twos_b);
+        CSA(twos_a, planes[0], planes[0], v[i + 4], v[i + 5]);
+        CSA(twos_b, planes[0], planes[0], v[i + 6], v[i + 7]);
+        CSA(fours_b, planes[1], planes[1], twos_a, twos_b);
+        CSA(eights, planes[2], planes[2], fours_a, fours_b);
+        ADD_LANES(planes, n_planes, 3, eights);
+    }
+    for (; i < length; ++i) {
+        ADD_LANES(planes, n_planes, 0, v[i]);
+    }
+    for (int b = 0; b < BATCH_LANES; ++b) {
+        weights[b] = lane_value(planes, n_planes, b);
+    }
+}
+
+static void lanes_weight(const lanes_t *restrict v, index_t length,
+                         index_t *restrict weights) {
+    if (length > 65536)
+        lanes_weight_body(v, length, weights, WEIGHT_PLANES);
+    else
+        lanes_weight_body(v, length, weights, 17);
+}
+
+void alloc_batch_decoder(batch_decoder_t dec, parameters_t params) {
+    dec->params = *params;
+    const index_t index = params->index;
+    const index_t block_length = params->block_length;
+
+    dec->tod_planes = 32 - __builtin_clz(params->ttl_saturate);
+    dec->syndrome = aligned_alloc(
+        64, (2 * block_length + LANES_BLOCK) * sizeof(lanes_t));
+    dec->bits = malloc(index * sizeof(lanes_t *));
+    dec->flips = malloc(index * sizeof(lanes_t *));
+    dec->tod = malloc(index * sizeof(lanes_t *));
+    for (index_t k = 0; k < index; ++k) {
+        dec->bits[k] = aligned_alloc(64, block_length * sizeof(lanes_t));
+        dec->flips[k] = aligned_alloc(
+            64, (2 * block_length + LANES_BLOCK) * sizeof(lanes_t));
+        dec->tod[k] = aligned_alloc(
+            64, dec->tod_planes * block_length * sizeof(lanes_t));
+    }
+    dec->ttl = malloc(params->block_weight + 1);
+    for (index_t diff = 0; diff <= params->block_weight; ++diff) {
+        dec->ttl[diff] = compute_ttl(params, diff);
+    }
+    dec->thresholds = NULL;
+}
+
+void free_batch_decoder(batch_decoder_t dec) {
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        free(dec->bits[k]);
+        free(dec->flips[k]);
+        free(dec->tod[k]);
+    }
+    free(dec->bits);
+    free(dec->flips);
+    free(dec->tod);
+    free(dec->syndrome);
+    free(dec->ttl);
+}
+
+/* Flip the positions 'j' of block 'k' of the lanes set in 'mask' in the
+ * syndromes. */
+static void lanes_flip_columns(batch_decoder_t dec, index_t k, index_t j,
+                               const lanes_t *mask) {
+    const index_t block_length = dec->params.block_length;
+    const sparse_t restrict column = dec->Hcolumns[k];
+
+    for (index_t l = 0; l < dec->params.block_weight; ++l) {
+        index_t i = j + column[l];
+        i -= (i >= block_length) ? block_length : 0;
+        dec->syndrome[i] ^= *mask;
+    }
+}
+
+/* Flip in the syndromes all the positions of block 'k' set in 'v', that is
+ * add the rotations of 'v' by the positions of the column. 'v' is duplicated
+ * first so that each rotation can be read as a contiguous range. */
+static void lanes_multiply_columns(batch_decoder_t dec, index_t k,
+                                   lanes_t *restrict v) {
+    const index_t block_length = dec->params.block_length;
+    const index_t block_weight = dec->params.block_weight;
+    const sparse_t restrict column = dec->Hcolumns[k];
+    lanes_t *restrict syndrome = dec->syndrome;
+
+    memcpy(v + block_length, v, block_length * sizeof(lanes_t));
+    for (index_t i = 0; i < block_length; i += LANES_BLOCK) {
+        /* syndrome[i] ^= v[i - column[l]] */
+        const lanes_t *restrict y = v + i + block_length;
+        lanes_t acc[LANES_BLOCK];
+        for (int t = 0; t < LANES_BLOCK; ++t) {
+            acc[t] = syndrome[i + t];
+        }
+        for (index_t l = 0; l < block_weight; ++l) {
+            for (int t = 0; t < LANES_BLOCK; ++t) {
+                acc[t] ^= y[t - column[l]];
+            }
+        }
+        for (int t = 0; t < LANES_BLOCK; ++t) {
+            syndrome[i + t] = acc[t];
+        }
+    }
+}
+
+/* Initialize the batch with the error patterns 'e_blocks[b]' (and
+ * 'e2_blocks[b]' for Ouroboros) for each lane 'b'. */
+void init_batch_decoder_error(batch_decoder_t dec, sparse_t *Hcolumns,
+                              sparse_t *e_blocks, sparse_t *e2_blocks) {
+    const index_t block_length = dec->params.block_length;
+
+    dec->Hcolumns = Hcolumns;
+    memset(dec->syndrome, 0, block_length * sizeof(lanes_t));
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        memset(dec->bits[k], 0, block_length * sizeof(lanes_t));
+    }
+    /* The error patterns are spread in 'dec->flips' to compute all the
+     * syndromes at once. */
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        memset(dec->flips[k], 0, block_length * sizeof(lanes_t));
+    }
+    for (int b = 0; b < BATCH_LANES; ++b) {
+        for (index_t l = 0; l < dec->params.error_weight; ++l) {
+            index_t k = e_blocks[b][l] / block_length;
+            index_t j = e_blocks[b][l] % block_length;
+            lane_flip(&dec->flips[k][j], b);
+        }
+        if (dec->params.ouroboros && e2_blocks) {
+            for (index_t l = 0; l < dec->params.syndrome_stop; ++l) {
+                lane_flip(&dec->syndrome[e2_blocks[b][l]], b);
+            }
+        }
+        dec->n_flipped[b] = 0;
+        dec->iter[b] = 0;
+    }
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        lanes_multiply_columns(dec, k, dec->flips[k]);
+    }
+    lanes_weight(dec->syndrome, block_length, dec->syndrome_weight);
+}
+
+/* Keep only the lanes that have not reached the target syndrome weight. */
+static void narrow_active(batch_decoder_t dec, lanes_t *active) {
+    for (int b = 0; b < BATCH_LANES; ++b) {
+        if (dec->syndrome_weight[b] == dec->params.syndrome_stop &&
+            lane_get(active, b))
+            lane_flip(active, b);
+    }
+}
+
+/* Compute the counters of block 'k' for all lanes as bit slices and flip the
+ * positions whose counter is at least the threshold of their lane. The
+ * syndromes are left untouched, 'dec->flips[k]' records the flipped lanes of
+ * each position. */
+ALWAYS_INLINE void compute_flips_body(batch_decoder_t dec, index_t k,
+                                      const lanes_t *restrict threshold,
+                                      const lanes_t *active, int n_planes) {
+    const index_t block_length = dec->params.block_length;
+    const index_t block_weight = dec->params.block_weight;
+    const int ttl_period = dec->params.ttl_saturate + 1;
+    const sparse_t restrict x = dec->Hcolumns[k];
+    lanes_t *restrict bits = dec->bits[k];
+    lanes_t *restrict tod = dec->tod[k];
+
+    for (index_t j = 0; j < block_length; ++j) {
+        const lanes_t *restrict y = dec->syndrome + j;
+        lanes_t planes[COUNTER_PLANES] = {0};
+        lanes_t twos_a, twos_b, fours_a, fours_b, eights;
+
+        /* Harley-Seal, as in the packed kernels. */
+        index_t l;
+        for (l = 0; l + 8 <= block_weight; l += 8) {
+            CSA(twos_a, planes[0], planes[0], y[x[l]], y[x[l + 1]]);
+            CSA(twos_b, planes[0], planes[0], y[x[l + 2]], y[x[l + 3]]);
+            CSA(fours_a, planes[1], planes[1], twos_a, twos_b);
+            CSA(twos_a, planes[0], planes[0], y[x[l + 4]], y[x[l + 5]]);
+            CSA(twos_b, planes[0], planes[0], y[x[l + 6]], y[x[l + 7]]);
+            CSA(fours_b, planes[1], planes[1], twos_a, twos_b);
+            CSA(eights, planes[2], planes[2], fours_a, fours_b);
+            ADD_LANES(planes, n_planes, 3, eights);
+        }
+        for (; l < block_weight; ++l) {
+            ADD_LANES(planes, n_planes, 0, y[x[l]]);
+        }
+
+        /* Bit-sliced comparison with the threshold of each lane. */
+        lanes_t gt = {0};
+        lanes_t eq = ~gt;
+        for (int p = n_planes - 1; p >= 0; --p) {
+            gt |= eq & planes[p] & ~threshold[p];
+            eq &= ~(planes[p] ^ threshold[p]);
+        }
+        lanes_t ge = (gt | eq) & *active;
+
+        dec->flips[k][j] = ge;
+        if (!lanes_any(&ge))
+            continue;
+        bits[j] ^= ge;
+        for (int w = 0; w < BATCH_WORDS; ++w) {
+            word_t mask = ge[w];
+            while (mask) {
+                int b = w * WORD_BITS + __builtin_ctzll(mask);
+                mask &= mask - 1;
+                if (!lane_get(&bits[j], b)) {
+                    --dec->n_flipped[b];
+                    continue;
+                }
+                ++dec->n_flipped[b];
+                unsigned counter = lane_value(planes, n_planes, b);
+                unsigned ttl = dec->ttl[counter - dec->threshold[b]];
+                unsigned t = (dec->iter[b] + ttl) % ttl_period;
+                for (int p = 0; p < dec->tod_planes; ++p) {
+                    lanes_t *plane = tod + p * block_length + j;
+                    if (lane_get(plane, b) != ((t >> p) & 1))
+                        lane_flip(plane, b);
+                }
+            }
+        }
+    }
+}
+
+static void compute_flips(batch_decoder_t dec, index_t k,
+                          const lanes_t *restrict threshold,
+                          const lanes_t *active) {
+    if (dec->params.block_weight > MAX_NARROW_WEIGHT)
+        compute_flips_body(dec, k, threshold, active, COUNTER_PLANES);
+    else
+        compute_flips_body(dec, k, threshold, active, 8);
+}
+
+/* Flip back the positions whose time of death is the current iteration. */
+static void expire_flips(batch_decoder_t dec, const lanes_t *active) {
+    const index_t block_length = dec->params.block_length;
+    /* All active lanes are at the same iteration. */
+    unsigned current_iter = 0;
+    for (int b = 0; b < BATCH_LANES; ++b) {
+        if (lane_get(active, b)) {
+            current_iter = dec->iter[b] % (dec->params.ttl_saturate + 1);
+            break;
+        }
+    }
+
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        lanes_t *restrict bits = dec->bits[k];
+        const lanes_t *restrict tod = dec->tod[k];
+        for (index_t j = 0; j < block_length; ++j) {
+            lanes_t expired = bits[j] & *active;
+            for (int p = 0; p < dec->tod_planes; ++p) {
+                lanes_t plane = tod[p * block_length + j];
+                expired &= ((current_iter >> p) & 1) ? plane : ~plane;
+            }
+            if (!lanes_any(&expired))
+                continue;
+            bits[j] ^= expired;
+            lanes_flip_columns(dec, k, j, &expired);
+            for (int w = 0; w < BATCH_WORDS; ++w) {
+                word_t mask = expired[w];
+                while (mask) {
+                    --dec->n_flipped[w * WORD_BITS + __builtin_ctzll(mask)];
+                    mask &= mask - 1;
+                }
+            }
+        }
+    }
+}
+
+/* Decode all the lanes of the batch. Lane 'b' is decoded when
+ * 'dec->syndrome_weight[b]' is the target syndrome weight, after
+ * 'dec->iter[b]' iterations. Each lane goes through exactly the same steps as
+ * with 'qcmdpc_decode_ttl'. */
+void batch_decode_ttl(batch_decoder_t dec, int max_iter) {
+    const index_t block_length = dec->params.block_length;
+
+    lanes_t active;
+    memset(&active, 0xff, sizeof(active));
+    narrow_active(dec, &active);
+    for (int iter = 1; iter <= max_iter && lanes_any(&active); ++iter) {
+        lanes_t threshold[COUNTER_PLANES] = {{0}};
+        for (int b = 0; b < BATCH_LANES; ++b) {
+            if (!lane_get(&active, b))
+                continue;
+            dec->iter[b] = iter;
+            int t = dec->params.error_weight - dec->n_flipped[b];
+            t = (t > 0) ? t : 1;
+            dec->threshold[b] =
+                dec->thresholds
+                    ? threshold_table_get(dec->thresholds,
+                                          dec->syndrome_weight[b], t)
+                    : compute_threshold(&dec->params, dec->syndrome_weight[b],
+                                        t);
+            for (int p = 0; p < COUNTER_PLANES; ++p) {
+                if ((dec->threshold[b] >> p) & 1)
+                    lane_flip(&threshold[p], b);
+            }
+        }
+
+        /* All counters are computed before the syndromes are updated. */
+        memcpy(dec->syndrome + block_length, dec->syndrome,
+               block_length * sizeof(lanes_t));
+        for (index_t k = 0; k < dec->params.index; ++k) {
+            compute_flips(dec, k, threshold, &active);
+        }
+        for (index_t k = 0; k < dec->params.index; ++k) {
+            lanes_multiply_columns(dec, k, dec->flips[k]);
+        }
+        lanes_weight(dec->syndrome, block_length, dec->syndrome_weight);
+
+        narrow_active(dec, &active);
+        if (lanes_any(&active)) {
+            expire_flips(dec, &active);
+            lanes_weight(dec->syndrome, block_length, dec->syndrome_weight);
+            narrow_active(dec, &active);
+        }
+    }
+}
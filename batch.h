@@ -0,0 +1,31 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef BATCH_H
+#define BATCH_H
+#include "types.h"
+
+void alloc_batch_decoder(batch_decoder_t dec, parameters_t params);
+void free_batch_decoder(batch_decoder_t dec);
+void init_batch_decoder_error(batch_decoder_t dec, sparse_t *Hcolumns,
+                              sparse_t *e_blocks, sparse_t *e2_blocks);
+void batch_decode_ttl(batch_decoder_t dec, int max_iter);
+#endif
@@ -0,0 +1,215 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+/* Header of a checkpoint file, followed by the 'ttl_table_length' values of
+ * the ttl table and the 'n_weights' error weights of a sweep as int64_t, the
+ * 2 * 'n_candidates' coefficients of the candidates as doubles, the
+ * 'shared_length' shared values and 'n_saved' saved states, each of
+ * 'saved_length' values */
+#define CHECKPOINT_MAGIC "QCMDPCC7"
+struct checkpoint_header {
+    char magic[8];
+    uint64_t seed;
+    int64_t shard;
+    int64_t index;
+    int64_t block_length;
+    int64_t block_weight;
+    int64_t error_weight;
+    int64_t ouroboros;
+    int64_t ttl_saturate;
+    double ttl_coeff0;
+    double ttl_coeff1;
+    int64_t ttl_table_length;
+    int64_t max_iter;
+    int64_t mode;
+    int64_t n_candidates;
+    int64_t n_weights;
+    int64_t sweep_epoch_keys;
+    int64_t key_size;
+    int64_t shared_length;
+    int64_t saved_length;
+    /* Not compared when loading */
+    int64_t n_saved;
+    int64_t next_key;
+};
+
+static void checkpoint_header(const struct checkpoint_run *run,
+                              long int shared_length, long int saved_length,
+                              struct checkpoint_header *header) {
+    const parameters_t params = run->params;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->seed = run->seed;
+    header->shard = run->shard;
+    header->index = params->index;
+    header->block_length = params->block_length;
+    header->block_weight = params->block_weight;
+    header->error_weight = params->error_weight;
+    header->ouroboros = params->ouroboros;
+    header->ttl_saturate = params->ttl_saturate;
+    header->ttl_coeff0 = params->ttl_coeff0;
+    header->ttl_coeff1 = params->ttl_coeff1;
+    header->ttl_table_length =
+        params->ttl_table ? params->ttl_table_length : 0;
+    header->max_iter = run->max_iter;
+    header->mode = run->mode;
+    header->n_candidates = run->n_candidates;
+    header->n_weights = run->n_weights;
+    header->sweep_epoch_keys = run->sweep_epoch_keys;
+    header->key_size = run->key_size;
+    header->shared_length = shared_length;
+    header->saved_length = saved_length;
+}
+
+/* The ttl table and the error weights, as written after the header */
+static void checkpoint_values(const struct checkpoint_run *run,
+                              const struct checkpoint_header *header,
+                              int64_t *values) {
+    for (index_t i = 0; i < header->ttl_table_length; ++i) {
+        *values++ = run->params->ttl_table[i];
+    }
+    for (index_t i = 0; i < header->n_weights; ++i) {
+        *values++ = run->weights[i];
+    }
+}
+
+/* The checkpoint is written to 'path.tmp' then renamed, so that 'path'
+ * always holds a complete checkpoint. The 'n_ranges' ranges of keys
+ * [ranges[2 * i], ranges[2 * i + 1]) not handed out to a thread yet are saved
+ * with zero counters. Returns 1 on success, 0 otherwise. */
+int checkpoint_save(const char *path, const struct checkpoint_run *run,
+                    long int next_key, const long int *shared,
+                    long int shared_length, const long int *ranges,
+                    long int n_ranges, stats_t const *threads,
+                    int n_threads) {
+    char tmp_path[strlen(path) + sizeof(".tmp")];
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp)
+        return 0;
+
+    const long int length = STATS_SAVED_LENGTH(threads[0]);
+    struct checkpoint_header header;
+    checkpoint_header(run, shared_length, length, &header);
+    header.n_saved = n_threads + n_ranges;
+    header.next_key = next_key;
+    const long int n_values = header.ttl_table_length + header.n_weights;
+    int64_t values[n_values + 1];
+    checkpoint_values(run, &header, values);
+    long int saved[length];
+    int ret = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(values, sizeof(int64_t), n_values, fp) == n_values &&
+              fwrite(run->candidates, sizeof(double), 2 * run->n_candidates,
+                     fp) == 2 * run->n_candidates &&
+              fwrite(shared, sizeof(long int), shared_length, fp) ==
+                  shared_length;
+    for (int t = 0; t < n_threads && ret; ++t) {
+        stats_read_saved(threads[t], saved);
+        ret = fwrite(saved, sizeof(long int), length, fp) == length;
+    }
+    memset(saved, 0, length * sizeof(long int));
+    for (long int i = 0; i < n_ranges && ret; ++i) {
+        saved[length - 2] = ranges[2 * i];
+        saved[length - 1] = ranges[2 * i + 1];
+        ret = fwrite(saved, sizeof(long int), length, fp) == length;
+    }
+    ret = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ret;
+    ret = fclose(fp) == 0 && ret;
+    return ret && rename(tmp_path, path) == 0;
+}
+
+static int compare_ranges(const void *a, const void *b) {
+    const long int x = *(const long int *)a, y = *(const long int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Load a checkpoint, whatever the number of threads that wrote it: the
+ * saved counters are summed in 'total', and the ranges of keys the threads
+ * had not decoded yet are returned in '*ranges' (allocated, sorted by their
+ * first key, in the layout of checkpoint_save) to be handed out again before
+ * 'next_key'. Returns 1 on success, 0 if the file does not exist and -1 if
+ * it is invalid or if it was written for another run. */
+int checkpoint_load(const char *path, const struct checkpoint_run *run,
+                    long int *next_key, long int *shared,
+                    long int shared_length, stats_t total, long int **ranges,
+                    long int *n_ranges) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    const long int length = STATS_SAVED_LENGTH(total);
+    struct checkpoint_header expected, header;
+    checkpoint_header(run, shared_length, length, &expected);
+    const long int n_values = expected.ttl_table_length + expected.n_weights;
+    int64_t expected_values[n_values + 1], values[n_values + 1];
+    checkpoint_values(run, &expected, expected_values);
+    double candidates[2 * run->n_candidates + 1];
+    long int saved[length];
+    int ret = -1;
+    *ranges = NULL;
+    *n_ranges = 0;
+    if (fread(&header, sizeof(header), 1, fp) != 1)
+        goto end;
+    expected.n_saved = header.n_saved;
+    expected.next_key = header.next_key;
+    if (memcmp(&header, &expected, sizeof(header)) || header.n_saved < 0)
+        goto end;
+    if (fread(values, sizeof(int64_t), n_values, fp) != n_values ||
+        memcmp(values, expected_values, n_values * sizeof(int64_t)))
+        goto end;
+    if (run->n_candidates &&
+        (fread(candidates, sizeof(double), 2 * run->n_candidates, fp) !=
+             2 * run->n_candidates ||
+         memcmp(candidates, run->candidates,
+                2 * run->n_candidates * sizeof(double))))
+        goto end;
+    if (fread(shared, sizeof(long int), shared_length, fp) != shared_length)
+        goto end;
+    memset(total->counters, 0, total->length * sizeof(long int));
+    *ranges = malloc((2 * header.n_saved + 1) * sizeof(long int));
+    for (long int i = 0; i < header.n_saved; ++i) {
+        if (fread(saved, sizeof(long int), length, fp) != length)
+            goto end;
+        for (long int j = 0; j < total->length; ++j) {
+            total->counters[j] += saved[j];
+        }
+        /* Threads that were done with their chunk have an empty range. */
+        if (saved[length - 2] < saved[length - 1]) {
+            (*ranges)[2 * *n_ranges] = saved[length - 2];
+            (*ranges)[2 * *n_ranges + 1] = saved[length - 1];
+            ++*n_ranges;
+        }
+    }
+    qsort(*ranges, *n_ranges, 2 * sizeof(long int), compare_ranges);
+    *next_key = header.next_key;
+    ret = 1;
+
+end:
+    fclose(fp);
+    return ret;
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include "stats.h"
+#include "types.h"
+
+/* What a run decodes and how: a checkpoint can only be resumed by a run for
+ * which all of them are the same. 'key_size' is the number of tests per
+ * key, 'mode' the MODE_* flags of the run, 'candidates' the ttl coefficients
+ * of --compare-ttl, 'weights' the error weights of a sweep and
+ * 'sweep_epoch_keys' the number of keys per epoch of its schedule. */
+struct checkpoint_run {
+    parameters_t params;
+    int max_iter;
+    int mode;
+    uint64_t seed;
+    long int shard;
+    long int key_size;
+    int n_candidates;
+    const double *candidates;
+    index_t n_weights;
+    const index_t *weights;
+    long int sweep_epoch_keys;
+};
+
+/* A checkpoint holds the counters and the position saved by stats_save of
+ * each thread, the first key not handed out to any thread yet and the
+ * 'shared_length' values of 'shared', the state shared by the threads (the
+ * sweep schedule). Since the instances of a key only depend on its index,
+ * resuming from it, with any number of threads, decodes the same instances
+ * as if the run had not been interrupted. */
+int checkpoint_save(const char *path, const struct checkpoint_run *run,
+                    long int next_key, const long int *shared,
+                    long int shared_length, const long int *ranges,
+                    long int n_ranges, stats_t const *threads,
+                    int n_threads);
+int checkpoint_load(const char *path, const struct checkpoint_run *run,
+                    long int *next_key, long int *shared,
+                    long int shared_length, stats_t total, long int **ranges,
+                    long int *n_ranges);
+#endif
@@ -22,8 +22,11 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cli.h"
+#include "output.h"
+#include "param.h"
 
 #define _GNU_SOURCE
 
@@ -36,6 +39,63 @@ void print_usage(char *arg0) {
             "-T, --threads          number of threads to use\n"
             "-q, --quiet            do not regularly output results (just on "
             "SIGHUP)\n"
+            "-K, --kernels          force the vector kernels to use (generic, "
+            "avx2 or avx512)\n"
+            "\n"
+            "-P, --preset           BIKE security level (128, 192 or 256)\n"
+            "-o, --ouroboros        use the Ouroboros variant (0 or 1)\n"
+            "-n, --index            number of circulant blocks\n"
+            "-r, --block-length     length of a block\n"
+            "-d, --block-weight     weight of a block\n"
+            "-t, --error-weight     weight of the error\n"
+            "    --ttl-coeff0       slope of the ttl function\n"
+            "    --ttl-coeff1       intercept of the ttl function\n"
+            "    --ttl-saturate     maximum value of the ttl function\n"
+            "    --ttl-table        ttl values T0,T1,... when the counter is 0, "
+            "1, ...\n"
+            "                       above the threshold (instead of the "
+            "coefficients)\n"
+            "\n"
+            "    --threshold-file   load thresholds from (and save them to) "
+            "this file\n"
+            "    --threshold-precompute\n"
+            "                       compute all thresholds before decoding\n"
+            "    --incremental      keep the counters up to date between "
+            "iterations\n"
+            "    --errors-per-key   number of error patterns to decode with "
+            "each parity\n"
+            "                       check matrix (and report per key)\n"
+            "    --importance-sampling\n"
+            "                       draw the overlap of the errors with a "
+            "near-codeword\n"
+            "                       uniformly and estimate the DFR by "
+            "reweighting\n"
+            "    --sweep            decode at error weights MIN:MAX[:STEP] and "
+            "fit the\n"
+            "                       log of the DFR\n"
+            "    --optimize-ttl     search the ttl coefficients minimizing the "
+            "DFR (with at\n"
+            "                       most --rounds tests per ttl function)\n"
+            "    --compare-ttl      decode the same instances with the ttl "
+            "coefficients\n"
+            "                       A0,B0:A1,B1:... and compare their DFR\n"
+            "    --batch            decode batches of error patterns in "
+            "lockstep (sharing\n"
+            "                       the same parity check matrix)\n"
+            "    --decode-threads   number of threads decoding each instance "
+            "(for large\n"
+            "                       blocks, in addition to --threads)\n"
+            "    --output           also write the reports to stdout as JSON "
+            "lines (json)\n"
+            "                       or binary records (binary)\n"
+            "    --checkpoint       regularly save the state of the run to "
+            "this file\n"
+            "    --resume           continue the run saved in the checkpoint "
+            "file\n"
+            "    --seed             seed of the PRNG (random by default)\n"
+            "    --shard            index of this process among those running "
+            "the same\n"
+            "                       seed (they decode disjoint instances)\n"
             "\n"
             "BIKE-1 BIKE-2\n"
             "Security  r    d   t\n"
@@ -51,39 +111,349 @@ void print_usage(char *arg0) {
     exit(2);
 }
 
-void parse_arguments(int argc, char *argv[], int *max_iter, long int *N,
-                     int *threads, int *quiet) {
-    const char *options = "i:N:T:q";
+/* Fill 'opts' with the options given or their default values, and 'params'
+ * with the code and decoder parameters given (it holds their default values
+ * on entry). */
+void parse_arguments(int argc, char *argv[], struct options *opts,
+                     parameters_t params) {
+    enum {
+        TTL_COEFF0_OPT = 256,
+        TTL_COEFF1_OPT,
+        TTL_SATURATE_OPT,
+        TTL_TABLE_OPT,
+        THRESHOLD_FILE_OPT,
+        THRESHOLD_PRECOMPUTE_OPT,
+        INCREMENTAL_OPT,
+        ERRORS_PER_KEY_OPT,
+        IMPORTANCE_SAMPLING_OPT,
+        SWEEP_OPT,
+        OPTIMIZE_TTL_OPT,
+        COMPARE_TTL_OPT,
+        BATCH_OPT,
+        DECODE_THREADS_OPT,
+        OUTPUT_OPT,
+        CHECKPOINT_OPT,
+        RESUME_OPT,
+        SEED_OPT,
+        SHARD_OPT
+    };
+    const char *options = "i:N:T:qK:P:o:n:r:d:t:";
     static struct option longopts[] = {{"max-iter", required_argument, 0, 'i'},
                                        {"rounds", required_argument, 0, 'N'},
                                        {"threads", required_argument, 0, 'T'},
                                        {"quiet", no_argument, 0, 'q'},
+                                       {"kernels", required_argument, 0, 'K'},
+                                       {"preset", required_argument, 0, 'P'},
+                                       {"ouroboros", required_argument, 0, 'o'},
+                                       {"index", required_argument, 0, 'n'},
+                                       {"block-length", required_argument, 0,
+                                        'r'},
+                                       {"block-weight", required_argument, 0,
+                                        'd'},
+                                       {"error-weight", required_argument, 0,
+                                        't'},
+                                       {"ttl-coeff0", required_argument, 0,
+                                        TTL_COEFF0_OPT},
+                                       {"ttl-coeff1", required_argument, 0,
+                                        TTL_COEFF1_OPT},
+                                       {"ttl-saturate", required_argument, 0,
+                                        TTL_SATURATE_OPT},
+                                       {"ttl-table", required_argument, 0,
+                                        TTL_TABLE_OPT},
+                                       {"threshold-file", required_argument, 0,
+                                        THRESHOLD_FILE_OPT},
+                                       {"threshold-precompute", no_argument, 0,
+                                        THRESHOLD_PRECOMPUTE_OPT},
+                                       {"incremental", no_argument, 0,
+                                        INCREMENTAL_OPT},
+                                       {"errors-per-key", required_argument, 0,
+                                        ERRORS_PER_KEY_OPT},
+                                       {"importance-sampling", no_argument, 0,
+                                        IMPORTANCE_SAMPLING_OPT},
+                                       {"sweep", required_argument, 0,
+                                        SWEEP_OPT},
+                                       {"optimize-ttl", no_argument, 0,
+                                        OPTIMIZE_TTL_OPT},
+                                       {"compare-ttl", required_argument, 0,
+                                        COMPARE_TTL_OPT},
+                                       {"batch", no_argument, 0, BATCH_OPT},
+                                       {"decode-threads", required_argument, 0,
+                                        DECODE_THREADS_OPT},
+                                       {"output", required_argument, 0,
+                                        OUTPUT_OPT},
+                                       {"checkpoint", required_argument, 0,
+                                        CHECKPOINT_OPT},
+                                       {"resume", no_argument, 0, RESUME_OPT},
+                                       {"seed", required_argument, 0,
+                                        SEED_OPT},
+                                       {"shard", required_argument, 0,
+                                        SHARD_OPT},
                                        {NULL, 0, 0, 0}};
 
+    *opts = (struct options){.max_iter = 100,
+                             .rounds = -1,
+                             .threads = 1,
+                             .decode_threads = 1,
+                             .output_format = OUTPUT_TEXT};
+
+    /* Explicit code parameters override the preset whatever their order. */
+    int preset = 0;
+    int ouroboros = -1;
+    index_t index = 0, block_length = 0, block_weight = 0, error_weight = 0;
+
     int ch;
     while ((ch = getopt_long(argc, argv, options, longopts, NULL)) != -1) {
         switch (ch) {
         case 'i':
-            *max_iter = atol(optarg);
-            if (*max_iter < 1)
+            opts->max_iter = atol(optarg);
+            if (opts->max_iter < 1)
                 print_usage(argv[0]);
             break;
         case 'N':
-            *N = atol(optarg);
-            if (*N < 1)
+            opts->rounds = atol(optarg);
+            if (opts->rounds < 1)
                 print_usage(argv[0]);
             break;
         case 'T':
-            *threads = atoi(optarg);
-            if (threads <= 0)
+            opts->threads = atoi(optarg);
+            if (opts->threads <= 0)
                 print_usage(argv[0]);
             break;
         case 'q':
-            *quiet = 1;
+            opts->quiet = 1;
+            break;
+        case 'K':
+            opts->kernels = optarg;
+            break;
+        case 'P':
+            preset = atoi(optarg);
+            break;
+        case 'o':
+            ouroboros = atoi(optarg);
+            if (ouroboros != 0 && ouroboros != 1)
+                print_usage(argv[0]);
+            break;
+        case 'n':
+            index = atol(optarg);
+            if (index < 1)
+                print_usage(argv[0]);
+            break;
+        case 'r':
+            block_length = atol(optarg);
+            if (block_length < 1)
+                print_usage(argv[0]);
+            break;
+        case 'd':
+            block_weight = atol(optarg);
+            if (block_weight < 1)
+                print_usage(argv[0]);
+            break;
+        case 't':
+            error_weight = atol(optarg);
+            if (error_weight < 1)
+                print_usage(argv[0]);
+            break;
+        case TTL_COEFF0_OPT:
+            params->ttl_coeff0 = atof(optarg);
+            break;
+        case TTL_COEFF1_OPT:
+            params->ttl_coeff1 = atof(optarg);
+            break;
+        case TTL_SATURATE_OPT:
+            params->ttl_saturate = atoi(optarg);
+            if (params->ttl_saturate < 1)
+                print_usage(argv[0]);
+            break;
+        case TTL_TABLE_OPT: {
+            /* Values separated by commas */
+            index_t n = 1;
+            for (const char *c = optarg; *c; ++c) {
+                n += (*c == ',');
+            }
+            uint8_t *table = malloc(n);
+            char *end = optarg;
+            for (index_t i = 0; i < n; ++i) {
+                long int value = strtol(end, &end, 10);
+                if (value < 1 || value > 255 ||
+                    *end != (i + 1 < n ? ',' : '\0'))
+                    print_usage(argv[0]);
+                table[i] = value;
+                ++end;
+            }
+            params->ttl_table = table;
+            params->ttl_table_length = n;
+            break;
+        }
+        case THRESHOLD_FILE_OPT:
+            opts->threshold_file = optarg;
+            break;
+        case THRESHOLD_PRECOMPUTE_OPT:
+            opts->precompute_thresholds = 1;
+            break;
+        case INCREMENTAL_OPT:
+#ifdef PACKED
+            /* Counters are never stored in the packed layout. */
+            fprintf(stderr, "--incremental is not available with PACKED.\n");
+            print_usage(argv[0]);
+#endif
+            opts->incremental = 1;
+            break;
+        case ERRORS_PER_KEY_OPT:
+            opts->errors_per_key = atol(optarg);
+            if (opts->errors_per_key < 1)
+                print_usage(argv[0]);
+            break;
+        case IMPORTANCE_SAMPLING_OPT:
+            opts->importance_sampling = 1;
+            break;
+        case SWEEP_OPT: {
+            long int min, max, step = 1;
+            if (sscanf(optarg, "%ld:%ld:%ld", &min, &max, &step) < 2 ||
+                min < 1 || max < min || step < 1)
+                print_usage(argv[0]);
+            opts->sweep_min = min;
+            opts->sweep_max = max;
+            opts->sweep_step = step;
+            break;
+        }
+        case OPTIMIZE_TTL_OPT:
+            opts->optimize = 1;
+            break;
+        case COMPARE_TTL_OPT: {
+            /* Pairs of coefficients separated by colons */
+            int n = 1;
+            for (const char *c = optarg; *c; ++c) {
+                n += (*c == ':');
+            }
+            opts->compare_ttl =
+                realloc(opts->compare_ttl, 2 * n * sizeof(double));
+            char *end = optarg;
+            for (int i = 0; i < n; ++i) {
+                opts->compare_ttl[2 * i] = strtod(end, &end);
+                if (*end++ != ',')
+                    print_usage(argv[0]);
+                opts->compare_ttl[2 * i + 1] = strtod(end, &end);
+                if (*end != (i + 1 < n ? ':' : '\0'))
+                    print_usage(argv[0]);
+                ++end;
+            }
+            opts->n_compare_ttl = n;
+            break;
+        }
+        case BATCH_OPT:
+            opts->batch = 1;
+            break;
+        case DECODE_THREADS_OPT:
+            opts->decode_threads = atoi(optarg);
+            if (opts->decode_threads < 1)
+                print_usage(argv[0]);
+            break;
+        case OUTPUT_OPT:
+            if (!strcmp(optarg, "text"))
+                opts->output_format = OUTPUT_TEXT;
+            else if (!strcmp(optarg, "json"))
+                opts->output_format = OUTPUT_JSON;
+            else if (!strcmp(optarg, "binary"))
+                opts->output_format = OUTPUT_BINARY;
+            else
+                print_usage(argv[0]);
+            break;
+        case CHECKPOINT_OPT:
+            opts->checkpoint_file = optarg;
+            break;
+        case RESUME_OPT:
+            opts->resume = 1;
+            break;
+        case SEED_OPT: {
+            char *end;
+            opts->seed = strtoull(optarg, &end, 0);
+            if (!*optarg || *end)
+                print_usage(argv[0]);
+            opts->seeded = 1;
+            break;
+        }
+        case SHARD_OPT:
+            opts->shard = atol(optarg);
+            if (opts->shard < 0 || opts->shard >= (1L << 32))
+                print_usage(argv[0]);
             break;
         default:
             print_usage(argv[0]);
             break;
         }
     }
+
+    if (opts->decode_threads > 1 && opts->batch) {
+        /* The lanes of a batch are already decoded together. */
+        fprintf(stderr, "--decode-threads is not available with --batch.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->importance_sampling && opts->batch) {
+        /* The sampled error patterns are decoded one at a time. */
+        fprintf(stderr,
+                "--importance-sampling is not available with --batch.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->sweep_step && (opts->batch || opts->importance_sampling)) {
+        /* The error weight changes from one decoding to the next. */
+        fprintf(stderr, "--sweep is not available with --batch or "
+                        "--importance-sampling.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->optimize &&
+        (opts->batch || opts->importance_sampling || opts->sweep_step)) {
+        fprintf(stderr, "--optimize-ttl is not available with --batch, "
+                        "--importance-sampling or --sweep.\n");
+        print_usage(argv[0]);
+    }
+
+    if (params->ttl_table && (opts->optimize || opts->n_compare_ttl)) {
+        /* Candidates are given by their coefficients. */
+        fprintf(stderr, "--ttl-table is not available with --optimize-ttl or "
+                        "--compare-ttl.\n");
+        print_usage(argv[0]);
+    }
+    if (opts->n_compare_ttl &&
+        (opts->batch || opts->importance_sampling || opts->sweep_step ||
+         opts->optimize)) {
+        fprintf(stderr, "--compare-ttl is not available with --batch, "
+                        "--importance-sampling, --sweep or --optimize-ttl.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->resume && !opts->checkpoint_file) {
+        fprintf(stderr, "--resume needs a --checkpoint file.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->shard && !opts->seeded) {
+        /* Shards partition the stream of one given seed. */
+        fprintf(stderr, "--shard needs a --seed.\n");
+        print_usage(argv[0]);
+    }
+
+    if (opts->checkpoint_file && opts->optimize) {
+        /* The state of the search is not part of the checkpoint. */
+        fprintf(stderr, "--checkpoint is not available with --optimize-ttl.\n");
+        print_usage(argv[0]);
+    }
+
+    if (ouroboros != -1)
+        params->ouroboros = ouroboros;
+    if (preset && !parameters_preset(params, preset, params->ouroboros))
+        print_usage(argv[0]);
+    if (index)
+        params->index = index;
+    if (block_length)
+        params->block_length = block_length;
+    if (block_weight)
+        params->block_weight = block_weight;
+    if (error_weight)
+        params->error_weight = error_weight;
+    if (preset || ouroboros != -1 || error_weight)
+        params->syndrome_stop =
+            params->ouroboros ? params->error_weight / 2 : 0;
 }
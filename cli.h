@@ -21,7 +21,47 @@
 */
 #ifndef CLI_H
 #define CLI_H
+#include "types.h"
+
+/* Options of the command line, other than the code and decoder parameters */
+struct options {
+    int max_iter;
+    /* Number of test rounds (-1 until the run is stopped) */
+    long int rounds;
+    int threads;
+    int quiet;
+    /* Vector kernels, chosen according to the CPU if NULL */
+    const char *kernels;
+    const char *threshold_file;
+    /* Compute all thresholds before decoding */
+    int precompute_thresholds;
+    /* Keep the counters up to date between iterations */
+    int incremental;
+    /* Reported per key if non zero */
+    long int errors_per_key;
+    int importance_sampling;
+    /* Range of error weights of a sweep (none if step is 0) */
+    index_t sweep_min, sweep_max, sweep_step;
+    /* Search the best ttl function instead of estimating the DFR */
+    int optimize;
+    /* With --compare-ttl, ttl coefficients of the candidates */
+    double *compare_ttl;
+    int n_compare_ttl;
+    /* Decode BATCH_LANES error patterns at once */
+    int batch;
+    /* Number of threads decoding each instance */
+    int decode_threads;
+    int output_format;
+    const char *checkpoint_file;
+    /* Continue the run saved in the checkpoint file */
+    int resume;
+    /* The seed was given */
+    int seeded;
+    uint64_t seed;
+    long int shard;
+};
+
 void print_usage(char *arg0);
-void parse_arguments(int argc, char *argv[], int *max_iter, long int *N,
-                     int *threads, int *quiet);
+void parse_arguments(int argc, char *argv[], struct options *opts,
+                     parameters_t params);
 #endif
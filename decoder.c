@@ -24,302 +24,706 @@
 
 #include "decoder.h"
 #include "param.h"
+#include "sampling.h"
 #include "sparse_cyclic.h"
 #include "threshold.h"
 
 static void fl_remove(fl_t fl, index_t pos);
-static void fl_add(fl_t fl, index_t pos);
-static void columns_to_rows(const sparse_t *restrict columns,
-                            sparse_t *restrict rows);
-static void compute_counters(const sparse_t *restrict columns,
-                             const sparse_t *restrict rows,
-                             const dense_t restrict checks,
-                             dense_t *restrict counters);
-static bit_t single_counter(const sparse_t restrict column, index_t position,
-                            const dense_t restrict syndrome);
-static void single_flip(const sparse_t restrict column, index_t position,
-                        dense_t restrict syndrome);
+static void fl_add(fl_t fl, index_t pos, uint8_t tod);
 static void compute_syndrome(decoder_t dec);
+static void init_syndrome(decoder_t dec, const sparse_t e2_block);
 
-void alloc_decoder(decoder_t dec) {
-    dec->bits = malloc(INDEX * sizeof(dense_t));
-    dec->e = malloc(INDEX * sizeof(dense_t));
-    dec->counters = malloc(INDEX * sizeof(bit_t *));
-    for (index_t i = 0; i < INDEX; ++i) {
+#ifndef PACKED
+/* Number of counters the vector kernels compute in the time it takes to
+ * update one counter at a random position (measured with AVX-512, the
+ * updates are mostly cache misses). */
+#define INCREMENTAL_RATIO 128
+
+#define GET_BIT(v, i) ((v)[i])
+#define SYNDROME_FLIP(v, i) (__atomic_fetch_xor((v) + (i), 1, __ATOMIC_RELAXED))
+#define FLIP_BIT(v, i) ((v)[i] ^= 1)
+#else
+#define GET_BIT(v, i) packed_get(v, i)
+#define SYNDROME_FLIP(v, i)                                                    \
+    ((__atomic_fetch_xor((v) + (i) / WORD_BITS, (word_t)1 << ((i) % WORD_BITS), \
+                         __ATOMIC_RELAXED) >>                                  \
+      ((i) % WORD_BITS)) &                                                     \
+     1)
+#define FLIP_BIT(v, i) packed_flip(v, i)
+#endif
+
+/* With several threads per decoder, the counters are computed by ranges of
+ * PARALLEL_CHUNK positions (a multiple of the tiles of all the kernels), and
+ * the flips are done in parallel when there are at least PARALLEL_MIN_FLIPS
+ * of them. */
+#define PARALLEL_CHUNK 1024
+#define PARALLEL_MIN_FLIPS 64
+
+void alloc_decoder(decoder_t dec, parameters_t params) {
+    dec->params = *params;
+    const index_t index = params->index;
+    const index_t block_length = params->block_length;
+
+    dec->bits = malloc(index * sizeof(dense_t));
+    dec->e = malloc(index * sizeof(dense_t));
+#ifndef PACKED
+    dec->wide = params->block_weight > MAX_NARROW_WEIGHT;
+    dec->counters = calloc(index, sizeof(bit_t *));
+    dec->wide_counters = calloc(index, sizeof(wide_t));
+    dec->incremental = 0;
+    /* A flip changes 'block_weight' syndrome bits, each of them changing
+     * 'index * block_weight' counters at random positions, while the full
+     * computation costs 'index * block_length * block_weight' additions done
+     * by vector instructions. */
+    dec->max_incremental_flips =
+        block_length / (INCREMENTAL_RATIO * params->block_weight);
+#endif
+    for (index_t i = 0; i < index; ++i) {
+#ifndef PACKED
+        dec->bits[i] =
+            aligned_alloc(64, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+        dec->e[i] =
+            aligned_alloc(64, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+        if (dec->wide)
+            dec->wide_counters[i] = aligned_alloc(
+                64, DENSE_LENGTH(2 * block_length) * sizeof(counter_t));
+        else
+            dec->counters[i] = aligned_alloc(
+                64, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+#else
         dec->bits[i] = aligned_alloc(
-            32, AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
+            64, PACKED_LENGTH(block_length) * sizeof(word_t));
         dec->e[i] = aligned_alloc(
-            32, AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
-        dec->counters[i] = aligned_alloc(
-            32, AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
+            64, PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+#endif
     }
+#ifndef PACKED
+    dec->syndrome =
+        aligned_alloc(64, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+    dec->initial_syndrome =
+        aligned_alloc(64, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+#else
     dec->syndrome = aligned_alloc(
-        32, AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
-    dec->Hrows = sparse_array_new(INDEX, BLOCK_WEIGHT);
+        64, PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+    dec->initial_syndrome = aligned_alloc(
+        64, PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+#endif
+    dec->candidates = malloc(index * block_length * sizeof(index_t));
+    dec->candidate_counters =
+        malloc(index * block_length * sizeof(counter_t));
+    dec->kernels = kernels_best();
+    dec->sample_bitmap = sample_bitmap_new(block_length);
+    dec->threads = 1;
+    dec->chunk_candidates =
+        malloc(index * ((block_length + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK) *
+               sizeof(index_t));
+    dec->thresholds = NULL;
+    dec->Hrows = sparse_array_new(index, params->block_weight);
+    dec->ttl = malloc(params->block_weight + 1);
+    update_decoder_ttl(dec);
+    const int ttl_period = params->ttl_saturate + 1;
     dec->fl = malloc(sizeof(struct flip_list));
-    dec->fl->tod = malloc(INDEX * BLOCK_LENGTH * sizeof(((fl_t)0)->tod));
-    dec->fl->next = malloc(INDEX * BLOCK_LENGTH * sizeof(((fl_t)0)->next));
-    dec->fl->prev = malloc(INDEX * BLOCK_LENGTH * sizeof(((fl_t)0)->prev));
+    dec->fl->buckets = malloc(ttl_period * sizeof(index_t *));
+    dec->fl->bucket_length = calloc(ttl_period, sizeof(index_t));
+    dec->fl->bucket_capacity = malloc(ttl_period * sizeof(index_t));
+    for (int b = 0; b < ttl_period; ++b) {
+        /* Grown when needed */
+        dec->fl->bucket_capacity[b] = 2 * params->block_weight;
+        dec->fl->buckets[b] =
+            malloc(dec->fl->bucket_capacity[b] * sizeof(index_t));
+    }
+    dec->fl->tod = malloc(index * block_length * sizeof(uint8_t));
+    dec->fl->slot = malloc(index * block_length * sizeof(index_t));
 }
 
 void free_decoder(decoder_t dec) {
-    for (index_t i = 0; i < INDEX; ++i) {
+    for (index_t i = 0; i < dec->params.index; ++i) {
         free(dec->bits[i]);
         free(dec->e[i]);
+#ifndef PACKED
         free(dec->counters[i]);
+        free(dec->wide_counters[i]);
+#endif
     }
     free(dec->bits);
     free(dec->syndrome);
+    free(dec->initial_syndrome);
     free(dec->e);
+#ifndef PACKED
     free(dec->counters);
-    sparse_array_free(INDEX, dec->Hrows);
+    free(dec->wide_counters);
+#endif
+    free(dec->candidates);
+    free(dec->candidate_counters);
+    free(dec->chunk_candidates);
+    free(dec->sample_bitmap);
+    sparse_array_free(dec->params.index, dec->Hrows);
+    free(dec->ttl);
+    for (int b = 0; b <= dec->params.ttl_saturate; ++b) {
+        free(dec->fl->buckets[b]);
+    }
+    free(dec->fl->buckets);
+    free(dec->fl->bucket_length);
+    free(dec->fl->bucket_capacity);
     free(dec->fl->tod);
-    free(dec->fl->next);
-    free(dec->fl->prev);
+    free(dec->fl->slot);
     free(dec->fl);
 }
 
+/* Tabulate the ttl function, to be called again when the ttl parameters of
+ * 'dec->params' change. A counter is at most 'block_weight' above the
+ * threshold. */
+void update_decoder_ttl(decoder_t dec) {
+    for (index_t diff = 0; diff <= dec->params.block_weight; ++diff) {
+        dec->ttl[diff] = compute_ttl(&dec->params, diff);
+    }
+}
+
 void reset_decoder(decoder_t dec) {
-    memset(dec->syndrome, 0,
-           AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
-    for (index_t i = 0; i < INDEX; ++i) {
-        memset(dec->bits[i], 0,
-               AVX_PADDING(2 * BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8);
+    const index_t block_length = dec->params.block_length;
+#ifndef PACKED
+    memset(dec->syndrome, 0, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+    for (index_t i = 0; i < dec->params.index; ++i) {
+        memset(dec->bits[i], 0, DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+    }
+#else
+    memset(dec->syndrome, 0, PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+    for (index_t i = 0; i < dec->params.index; ++i) {
+        memset(dec->bits[i], 0, PACKED_LENGTH(block_length) * sizeof(word_t));
     }
-    dec->fl->first = -1;
+#endif
+    memset(dec->fl->bucket_length, 0,
+           (dec->params.ttl_saturate + 1) * sizeof(index_t));
     dec->fl->length = 0;
+#ifndef PACKED
+    dec->counters_valid = 0;
+#endif
 }
 
+/* Move the last position of the bucket in place of the removed one. */
 static void fl_remove(fl_t fl, index_t pos) {
-    index_t next = fl->next[pos];
-    index_t prev = fl->prev[pos];
-    if (next != -1) {
-        fl->prev[next] = prev;
-    }
-    if (prev != -1) {
-        fl->next[prev] = next;
-    }
-    else {
-        fl->first = next;
-    }
+    uint8_t tod = fl->tod[pos];
+    index_t last = fl->buckets[tod][--fl->bucket_length[tod]];
+    fl->buckets[tod][fl->slot[pos]] = last;
+    fl->slot[last] = fl->slot[pos];
     --fl->length;
 }
 
-static void fl_add(fl_t fl, index_t pos) {
-    fl->next[pos] = fl->first;
-    fl->prev[pos] = -1;
-    if (fl->first != -1)
-        fl->prev[fl->first] = pos;
-    fl->first = pos;
+static void fl_add(fl_t fl, index_t pos, uint8_t tod) {
+    if (fl->bucket_length[tod] == fl->bucket_capacity[tod]) {
+        fl->bucket_capacity[tod] *= 2;
+        fl->buckets[tod] = realloc(fl->buckets[tod],
+                                   fl->bucket_capacity[tod] * sizeof(index_t));
+    }
+    fl->tod[pos] = tod;
+    fl->slot[pos] = fl->bucket_length[tod];
+    fl->buckets[tod][fl->bucket_length[tod]++] = pos;
     ++fl->length;
 }
 
-void init_decoder_error(decoder_t dec, sparse_t *Hcolumns,
-                        const sparse_t e_block, const sparse_t e2_block) {
+/* Draw a random parity check matrix in 'Hcolumns' and use it for the next
+ * decodings. Its rows are written at the same time, once per key. */
+void rand_decoder_key(decoder_t dec, sparse_t *Hcolumns, prng_t prng) {
     dec->Hcolumns = Hcolumns;
-    columns_to_rows(Hcolumns, dec->Hrows);
-    // dec->error_weight = ERROR_WEIGHT;
+    for (index_t k = 0; k < dec->params.index; ++k) {
+        circulant_rand(dec->params.block_length, dec->params.block_weight,
+                       prng, dec->sample_bitmap, Hcolumns[k], dec->Hrows[k]);
+    }
+}
+
+static void clear_error(decoder_t dec) {
+    const index_t block_length = dec->params.block_length;
 
-    for (index_t k = 0; k < INDEX; ++k) {
-        for (index_t j = 0; j < BLOCK_LENGTH; ++j) {
+    for (index_t k = 0; k < dec->params.index; ++k) {
+#ifndef PACKED
+        for (index_t j = 0; j < block_length; ++j) {
             dec->e[k][j] = 0;
         }
+#else
+        memset(dec->e[k], 0, PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+#endif
     }
-    index_t k;
-    for (k = 0; k < ERROR_WEIGHT; ++k) {
-        index_t j = e_block[k];
-        if (j >= BLOCK_LENGTH)
-            break;
-        dec->e[0][j] = 1;
+}
+
+void init_decoder_error(decoder_t dec, const sparse_t e_block,
+                        const sparse_t e2_block) {
+    const index_t block_length = dec->params.block_length;
+    const index_t error_weight = dec->params.error_weight;
+
+    clear_error(dec);
+    for (index_t l = 0; l < error_weight; ++l) {
+        FLIP_BIT(dec->e[e_block[l] / block_length], e_block[l] % block_length);
     }
-    for (; k < ERROR_WEIGHT; ++k) {
-        index_t j = e_block[k] - BLOCK_LENGTH;
-        dec->e[1][j] = 1;
+    init_syndrome(dec, e2_block);
+}
+
+/* Draw a random error pattern directly in 'dec->e', which serves as the
+ * bitmap of the rejection sampling. The error on the syndrome (for
+ * Ouroboros) is drawn in 'dec->candidates', unused until decoding starts. */
+void rand_decoder_error(decoder_t dec, prng_t prng) {
+    const index_t block_length = dec->params.block_length;
+    const index_t length = dec->params.index * block_length;
+
+    clear_error(dec);
+    for (index_t l = 0; l < dec->params.error_weight; ++l) {
+        index_t k, j;
+        do {
+            const index_t pos = prng_lim(prng, length - 1);
+            k = pos / block_length;
+            j = pos % block_length;
+        } while (GET_BIT(dec->e[k], j));
+        FLIP_BIT(dec->e[k], j);
     }
+    sparse_t e2_block = NULL;
+    if (dec->params.ouroboros)
+        e2_block = sparse_rand_unsorted(block_length,
+                                        dec->params.syndrome_stop, prng,
+                                        dec->sample_bitmap, dec->candidates);
+    init_syndrome(dec, e2_block);
+}
+
+/* Syndrome of the error in 'dec->e', plus 'e2_block' for Ouroboros */
+static void init_syndrome(decoder_t dec, const sparse_t e2_block) {
+    const index_t block_length = dec->params.block_length;
+
     compute_syndrome(dec);
 
-#if OUROBOROS
-    if (e2_block) {
-        for (index_t k = 0; k < SYNDROME_STOP; ++k) {
-            dec->syndrome[e2_block[k]] ^= 1;
+    if (dec->params.ouroboros && e2_block) {
+        for (index_t k = 0; k < dec->params.syndrome_stop; ++k) {
+            FLIP_BIT(dec->syndrome, e2_block[k]);
         }
     }
-#endif
     dec->syndrome_weight = 0;
-    for (index_t j = 0; j < BLOCK_LENGTH; ++j) {
+#ifndef PACKED
+    for (index_t j = 0; j < block_length; ++j) {
         dec->syndrome_weight += dec->syndrome[j];
     }
+#else
+    for (index_t j = 0; j < (block_length + WORD_BITS - 1) / WORD_BITS; ++j) {
+        dec->syndrome_weight += __builtin_popcountll(dec->syndrome[j]);
+    }
+#endif
+#ifndef PACKED
+    memcpy(dec->initial_syndrome, dec->syndrome,
+           DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+#else
+    memcpy(dec->initial_syndrome, dec->syndrome,
+           PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+#endif
+    dec->initial_syndrome_weight = dec->syndrome_weight;
 }
 
-static void columns_to_rows(const sparse_t *restrict columns,
-                            sparse_t *restrict rows) {
-    for (index_t i = 0; i < INDEX; ++i) {
-        index_t l = 0;
-        if ((*columns)[0] == 0) {
-            (*rows)[0] = 0;
-            l = 1;
-        }
-        else {
-            (*rows)[0] = -(*columns)[BLOCK_WEIGHT - 1] + BLOCK_LENGTH;
+/* Go back to the state of the decoder right after init_decoder_error, to
+ * decode the same instance again (with other ttl coefficients). */
+void restart_decoder(decoder_t dec) {
+    const index_t block_length = dec->params.block_length;
+
+    reset_decoder(dec);
+#ifndef PACKED
+    memcpy(dec->syndrome, dec->initial_syndrome,
+           DENSE_LENGTH(2 * block_length) * sizeof(bit_t));
+#else
+    memcpy(dec->syndrome, dec->initial_syndrome,
+           PACKED_LENGTH(2 * block_length) * sizeof(word_t));
+#endif
+    dec->syndrome_weight = dec->initial_syndrome_weight;
+}
+
+static void compute_syndrome(decoder_t dec) {
+    const index_t block_length = dec->params.block_length;
+
+    for (index_t i = 0; i < dec->params.index; ++i) {
+#ifndef PACKED
+        memcpy(dec->e[i] + block_length, dec->e[i],
+               block_length * sizeof(bit_t));
+        dec->kernels->multiply_mod2(block_length, dec->params.block_weight,
+                                    dec->Hrows[i], dec->e[i], dec->syndrome);
+#else
+        packed_duplicate(block_length, dec->e[i]);
+        dec->kernels->multiply_mod2_packed(block_length,
+                                           dec->params.block_weight,
+                                           dec->Hrows[i], dec->e[i],
+                                           dec->syndrome);
+#endif
+    }
+}
+
+/* Write in 'positions' (relative to 'start') and 'values' the candidates
+ * among the 'length' positions of block 'i' from 'start', computing their
+ * counters first if 'full'. */
+ALWAYS_INLINE index_t range_candidates(decoder_t dec, index_t block_weight,
+                                       index_t i, index_t start,
+                                       index_t length, int full,
+                                       unsigned threshold,
+                                       index_t *restrict positions,
+                                       counter_t *restrict values) {
+#ifndef PACKED
+    if (dec->wide)
+        return full ? dec->kernels->multiply_threshold_wide(
+                          length, block_weight, dec->Hcolumns[i],
+                          dec->syndrome + start, dec->wide_counters[i] + start,
+                          threshold, positions, values)
+                    : dec->kernels->above_threshold_wide(
+                          length, dec->wide_counters[i] + start, threshold,
+                          positions, values);
+    return full ? dec->kernels->multiply_threshold(
+                      length, block_weight, dec->Hcolumns[i],
+                      dec->syndrome + start, dec->counters[i] + start,
+                      threshold, positions, values)
+                : dec->kernels->above_threshold(length,
+                                                dec->counters[i] + start,
+                                                threshold, positions, values);
+#else
+    (void)full;
+    return dec->kernels->multiply_threshold_packed(
+        length, block_weight, dec->Hcolumns[i],
+        dec->syndrome + start / WORD_BITS, threshold, positions, values);
+#endif
+}
+
+/* Compute the counters and the candidates, each thread taking ranges of
+ * positions. The candidates of a range are written at its own offset and
+ * gathered in order, the result is the same as with a single thread. */
+static void compute_candidates_parallel(decoder_t dec, unsigned threshold) {
+    const index_t block_length = dec->params.block_length;
+    const index_t block_weight = dec->params.block_weight;
+    const index_t chunks = (block_length + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+
+#pragma omp parallel for schedule(dynamic) num_threads(dec->threads)
+    for (index_t c = 0; c < dec->params.index * chunks; ++c) {
+        index_t i = c / chunks;
+        index_t start = (c % chunks) * PARALLEL_CHUNK;
+        index_t length = (block_length - start < PARALLEL_CHUNK)
+                             ? block_length - start
+                             : PARALLEL_CHUNK;
+        index_t offset = i * block_length + start;
+        index_t n = range_candidates(dec, block_weight, i, start, length, 1,
+                                     threshold, dec->candidates + offset,
+                                     dec->candidate_counters + offset);
+        for (index_t k = 0; k < n; ++k) {
+            dec->candidates[offset + k] += offset;
         }
-        for (index_t k = 1; k < BLOCK_WEIGHT; ++k) {
-            (*rows)[k] = -(*columns)[BLOCK_WEIGHT + l - 1 - k] + BLOCK_LENGTH;
+        dec->chunk_candidates[c] = n;
+    }
+
+    dec->n_candidates = 0;
+    for (index_t c = 0; c < dec->params.index * chunks; ++c) {
+        index_t offset =
+            (c / chunks) * block_length + (c % chunks) * PARALLEL_CHUNK;
+        memmove(dec->candidates + dec->n_candidates, dec->candidates + offset,
+                dec->chunk_candidates[c] * sizeof(index_t));
+        memmove(dec->candidate_counters + dec->n_candidates,
+                dec->candidate_counters + offset,
+                dec->chunk_candidates[c] * sizeof(counter_t));
+        dec->n_candidates += dec->chunk_candidates[c];
+    }
+}
+
+/* Flip the 'n' positions (k * block_length + j) of 'positions'. The threads
+ * update the syndrome with atomic operations, and since the flips commute the
+ * result is the same as flipping them one after the other. */
+static void flip_bits_parallel(decoder_t dec, const index_t *positions,
+                               index_t n) {
+    const index_t block_length = dec->params.block_length;
+    const index_t block_weight = dec->params.block_weight;
+    index_t delta = 0;
+
+#pragma omp parallel for num_threads(dec->threads) reduction(+ : delta)
+    for (index_t c = 0; c < n; ++c) {
+        index_t k = positions[c] / block_length;
+        index_t j = positions[c] % block_length;
+        const sparse_t column = dec->Hcolumns[k];
+        for (index_t l = 0; l < block_weight; ++l) {
+            index_t i = j + column[l];
+            i -= (i >= block_length) ? block_length : 0;
+            delta += SYNDROME_FLIP(dec->syndrome, i) ? -1 : 1;
         }
-        ++rows;
-        ++columns;
+    }
+    dec->syndrome_weight += delta;
+    for (index_t c = 0; c < n; ++c) {
+        FLIP_BIT(dec->bits[positions[c] / block_length],
+                 positions[c] % block_length);
     }
 }
 
-static void compute_counters(const sparse_t *restrict columns,
-                             const sparse_t *restrict rows,
-                             const dense_t restrict checks,
-                             dense_t *restrict counters) {
-    memcpy(checks + BLOCK_LENGTH, checks, BLOCK_LENGTH * sizeof(bit_t));
-    for (index_t i = 0; i < INDEX; ++i) {
-#ifndef AVX
-        memset(counters[i], 0, BLOCK_LENGTH * sizeof(bit_t));
-        multiply(BLOCK_LENGTH, BLOCK_WEIGHT, rows[i], checks, counters[i]);
+/* The functions below are inlined in the decoding loop, which is instantiated
+ * once for each BIKE preset (with constant 'index', 'block_length' and
+ * 'block_weight') and once for arbitrary parameters. */
+
+/* Fill the list of positions whose counter reaches the threshold. */
+ALWAYS_INLINE void compute_candidates(decoder_t dec, index_t index,
+                                      index_t block_length,
+                                      index_t block_weight,
+                                      unsigned threshold) {
+#ifndef PACKED
+    /* In incremental mode, the counters only need to be computed if they
+     * were not kept up to date. */
+    int full = !dec->counters_valid;
+    if (full) {
+        memcpy(dec->syndrome + block_length, dec->syndrome,
+               block_length * sizeof(bit_t));
+        dec->counters_valid = dec->incremental;
+    }
+    dec->incremental_flips = 0;
 #else
-        multiply_avx2(AVX_PADDING(BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8,
-                      BLOCK_WEIGHT, columns[i], checks, counters[i]);
+    /* The counters are computed as bit slices and only those reaching the
+     * threshold are kept. */
+    packed_duplicate(block_length, dec->syndrome);
+    const int full = 1;
 #endif
+    if (dec->threads > 1 && full) {
+        compute_candidates_parallel(dec, threshold);
+        return;
+    }
+    dec->n_candidates = 0;
+    for (index_t i = 0; i < index; ++i) {
+        index_t *positions = dec->candidates + dec->n_candidates;
+        /* The counters are a snapshot of the syndrome at the start of the
+         * iteration, the flips of the iteration do not change the
+         * candidates and nothing has to be checked again. */
+        index_t n = range_candidates(
+            dec, block_weight, i, 0, block_length, full, threshold, positions,
+            dec->candidate_counters + dec->n_candidates);
+        for (index_t c = 0; c < n; ++c) {
+            positions[c] += i * block_length;
+        }
+        dec->n_candidates += n;
     }
 }
 
-static bit_t single_counter(const sparse_t restrict column, index_t position,
-                            const dense_t restrict syndrome) {
-    bit_t counter = 0;
+#ifndef PACKED
+ALWAYS_INLINE counter_t single_counter(index_t block_length,
+                                       index_t block_weight,
+                                       const sparse_t restrict column,
+                                       index_t position,
+                                       const dense_t restrict syndrome) {
+    counter_t counter = 0;
     index_t offset = position;
 
     index_t l;
-    for (l = 0; l < BLOCK_WEIGHT; ++l) {
+    for (l = 0; l < block_weight; ++l) {
         index_t i = offset + column[l];
-        if (i >= BLOCK_LENGTH) {
-            offset -= BLOCK_LENGTH;
+        if (i >= block_length) {
+            offset -= block_length;
             break;
         }
         counter += syndrome[i];
     }
-    for (; l < BLOCK_WEIGHT; ++l) {
+    for (; l < block_weight; ++l) {
         index_t i = offset + column[l];
         counter += syndrome[i];
     }
     return counter;
 }
 
-static void single_flip(const sparse_t restrict column, index_t position,
-                        dense_t restrict syndrome) {
+ALWAYS_INLINE void single_flip(index_t block_length, index_t block_weight,
+                               const sparse_t restrict column,
+                               index_t position, dense_t restrict syndrome);
+
+/* Update the counters after the flip of 'position' (in the block of
+ * 'column'): each syndrome bit it changed is added or subtracted to the
+ * counters of the positions of its row. */
+ALWAYS_INLINE void update_counters(decoder_t dec, index_t index,
+                                   index_t block_length, index_t block_weight,
+                                   const sparse_t restrict column,
+                                   index_t position) {
+    for (index_t l = 0; l < block_weight; ++l) {
+        index_t i = position + column[l];
+        i -= (i >= block_length) ? block_length : 0;
+        int delta = dec->syndrome[i] ? 1 : -1;
+        for (index_t k = 0; k < index; ++k) {
+            const sparse_t restrict row = dec->Hrows[k];
+            if (dec->wide) {
+                wide_t restrict counters = dec->wide_counters[k];
+                for (index_t m = 0; m < block_weight; ++m) {
+                    index_t j = i + row[m];
+                    j -= (j >= block_length) ? block_length : 0;
+                    counters[j] += delta;
+                }
+                continue;
+            }
+            bit_t *restrict counters = dec->counters[k];
+            for (index_t m = 0; m < block_weight; ++m) {
+                index_t j = i + row[m];
+                j -= (j >= block_length) ? block_length : 0;
+                counters[j] += delta;
+            }
+        }
+    }
+}
+
+ALWAYS_INLINE void single_flip(index_t block_length, index_t block_weight,
+                               const sparse_t restrict column,
+                               index_t position, dense_t restrict syndrome) {
     index_t offset = position;
 
     index_t l;
-    for (l = 0; l < BLOCK_WEIGHT; ++l) {
+    for (l = 0; l < block_weight; ++l) {
         index_t i = position + column[l];
-        if (i >= BLOCK_LENGTH) {
-            offset -= BLOCK_LENGTH;
+        if (i >= block_length) {
+            offset -= block_length;
             break;
         }
         syndrome[i] ^= 1;
     }
-    for (; l < BLOCK_WEIGHT; ++l) {
+    for (; l < block_weight; ++l) {
         index_t i = offset + column[l];
         syndrome[i] ^= 1;
     }
 }
+#else
+ALWAYS_INLINE counter_t single_counter(index_t block_length,
+                                       index_t block_weight,
+                                       const sparse_t restrict column,
+                                       index_t position,
+                                       const packed_t restrict syndrome) {
+    counter_t counter = 0;
 
-#ifndef AVX
-static void compute_syndrome(decoder_t dec) {
-    for (index_t i = 0; i < INDEX; ++i) {
-        multiply_mod2(BLOCK_LENGTH, BLOCK_WEIGHT, dec->Hcolumns[i], dec->e[i],
-                      dec->syndrome);
+    for (index_t l = 0; l < block_weight; ++l) {
+        index_t i = position + column[l];
+        i -= (i >= block_length) ? block_length : 0;
+        counter += packed_get(syndrome, i);
     }
+    return counter;
 }
-#else
-static void compute_syndrome(decoder_t dec) {
-    for (index_t i = 0; i < INDEX; ++i) {
-        memcpy(dec->e[i] + BLOCK_LENGTH, dec->e[i],
-               BLOCK_LENGTH * sizeof(bit_t));
-        multiply_mod2_avx2(AVX_PADDING(BLOCK_LENGTH * 8 * sizeof(bit_t)) / 8,
-                           BLOCK_WEIGHT, dec->Hrows[i], dec->e[i],
-                           dec->syndrome);
+
+ALWAYS_INLINE void single_flip(index_t block_length, index_t block_weight,
+                               const sparse_t restrict column,
+                               index_t position, packed_t restrict syndrome) {
+    for (index_t l = 0; l < block_weight; ++l) {
+        index_t i = position + column[l];
+        i -= (i >= block_length) ? block_length : 0;
+        packed_flip(syndrome, i);
     }
 }
 #endif
 
-static inline int compute_ttl(int diff) {
-    int ttl = (int)((diff)*TTL_COEFF0 + TTL_COEFF1);
+/* Flip position 'j' of block 'k' and update the syndrome. */
+ALWAYS_INLINE void flip_bit(decoder_t dec, index_t index, index_t block_length,
+                            index_t block_weight, index_t k, index_t j) {
+    counter_t counter = single_counter(block_length, block_weight,
+                                       dec->Hcolumns[k], j, dec->syndrome);
+    single_flip(block_length, block_weight, dec->Hcolumns[k], j,
+                dec->syndrome);
+#ifndef PACKED
+    if (dec->counters_valid) {
+        if (++dec->incremental_flips > dec->max_incremental_flips)
+            dec->counters_valid = 0;
+        else
+            update_counters(dec, index, block_length, block_weight,
+                            dec->Hcolumns[k], j);
+    }
+#endif
+    FLIP_BIT(dec->bits[k], j);
+    dec->syndrome_weight += block_weight - 2 * counter;
+    // dec->error_weight += 2 * (dec->bits[k][j] ^ dec->e[k][j]) - 1;
+}
 
-    ttl = (ttl < 1) ? 1 : ttl;
-    return (ttl > TTL_SATURATE) ? TTL_SATURATE : ttl;
+/* Update the flip list before the flip of position 'j' of block 'k' whose
+ * counter is 'diff' above the threshold. */
+ALWAYS_INLINE void record_flip(decoder_t dec, index_t block_length, index_t k,
+                               index_t j, int diff) {
+    if (GET_BIT(dec->bits[k], j)) {
+        fl_remove(dec->fl, k * block_length + j);
+    }
+    else {
+        uint8_t ttl = dec->ttl[diff];
+
+        fl_add(dec->fl, k * block_length + j,
+               (dec->iter + ttl) % (dec->params.ttl_saturate + 1));
+    }
 }
 
-int qcmdpc_decode_ttl(decoder_t dec, int max_iter) {
+/* Whether 'n' flips are done by flip_bits_parallel. The incremental counters
+ * are only updated by flip_bit. */
+ALWAYS_INLINE int parallel_flips(decoder_t dec, index_t n) {
+#ifndef PACKED
+    if (dec->counters_valid)
+        return 0;
+#endif
+    return dec->threads > 1 && n >= PARALLEL_MIN_FLIPS;
+}
+
+ALWAYS_INLINE int decode_ttl_body(decoder_t dec, int max_iter, index_t index,
+                                  index_t block_length,
+                                  index_t block_weight) {
+    const index_t syndrome_stop = dec->params.syndrome_stop;
+    const int ttl_period = dec->params.ttl_saturate + 1;
+
     dec->iter = 0;
     unsigned threshold;
     int recompute_threshold = 1;
-    while (dec->iter < max_iter && dec->syndrome_weight != SYNDROME_STOP) {
+    while (dec->iter < max_iter && dec->syndrome_weight != syndrome_stop) {
         ++dec->iter;
-        compute_counters(dec->Hcolumns, dec->Hrows, dec->syndrome,
-                         dec->counters);
+        /* The threshold only depends on the syndrome weight and on the
+         * number of flips, it can be computed before the counters. */
         if (recompute_threshold) {
-            int t = ERROR_WEIGHT - dec->fl->length;
+            int t = dec->params.error_weight - dec->fl->length;
             t = (t > 0) ? t : 1;
-            threshold = compute_threshold(dec->syndrome_weight, t);
+            threshold =
+                dec->thresholds
+                    ? threshold_table_get(dec->thresholds, dec->syndrome_weight,
+                                          t)
+                    : compute_threshold(&dec->params, dec->syndrome_weight, t);
             recompute_threshold = 0;
         }
 
-        for (index_t k = 0; k < INDEX; ++k) {
-            for (index_t j = 0; j < BLOCK_LENGTH; ++j) {
-                if (dec->counters[k][j] >= threshold) {
-                    recompute_threshold = 1;
-                    if (dec->bits[k][j]) {
-                        fl_remove(dec->fl, k * BLOCK_LENGTH + j);
-                    }
-                    else {
-                        uint8_t ttl =
-                            compute_ttl(dec->counters[k][j] - threshold);
-
-                        fl_add(dec->fl, k * BLOCK_LENGTH + j);
-                        dec->fl->tod[k * BLOCK_LENGTH + j] =
-                            (dec->iter + ttl) % (TTL_SATURATE + 1);
-                    }
-                    bit_t counter =
-                        single_counter(dec->Hcolumns[k], j, dec->syndrome);
-                    single_flip(dec->Hcolumns[k], j, dec->syndrome);
-                    dec->bits[k][j] ^= 1;
-                    dec->syndrome_weight += BLOCK_WEIGHT - 2 * counter;
-                    // dec->error_weight += 2 * (dec->bits[k][j] ^ dec->e[k][j])
-                    // - 1;
-                }
-            }
+        compute_candidates(dec, index, block_length, block_weight, threshold);
+        int parallel = parallel_flips(dec, dec->n_candidates);
+        for (index_t c = 0; c < dec->n_candidates; ++c) {
+            index_t k = dec->candidates[c] / block_length;
+            index_t j = dec->candidates[c] % block_length;
+            recompute_threshold = 1;
+            record_flip(dec, block_length, k, j,
+                        dec->candidate_counters[c] - threshold);
+            if (!parallel)
+                flip_bit(dec, index, block_length, block_weight, k, j);
         }
-        if (dec->syndrome_weight != SYNDROME_STOP && dec->fl->length) {
-            uint8_t current_iter = dec->iter % (TTL_SATURATE + 1);
-            index_t fl_pos = dec->fl->first;
-            while (fl_pos != -1) {
-                if (dec->fl->tod[fl_pos] == current_iter) {
-                    index_t k = 0;
-                    index_t j = fl_pos;
-                    if (fl_pos >= BLOCK_LENGTH) {
-                        k = 1;
-                        j -= BLOCK_LENGTH;
-                    }
-
-                    bit_t counter =
-                        single_counter(dec->Hcolumns[k], j, dec->syndrome);
-                    single_flip(dec->Hcolumns[k], j, dec->syndrome);
-                    dec->bits[k][j] ^= 1;
-                    dec->syndrome_weight += BLOCK_WEIGHT - 2 * counter;
-                    // dec->error_weight += 2 * (dec->bits[k][j] ^ dec->e[k][j])
-                    // - 1;
+        if (parallel)
+            flip_bits_parallel(dec, dec->candidates, dec->n_candidates);
+        if (dec->syndrome_weight != syndrome_stop && dec->fl->length) {
+            /* The order of the flips does not matter. */
+            uint8_t current_iter = dec->iter % ttl_period;
+            const index_t *expired = dec->fl->buckets[current_iter];
+            index_t n_expired = dec->fl->bucket_length[current_iter];
+            if (parallel_flips(dec, n_expired)) {
+                flip_bits_parallel(dec, expired, n_expired);
+                recompute_threshold = 1;
+            }
+            else {
+                for (index_t e = 0; e < n_expired; ++e) {
+                    index_t k = expired[e] / block_length;
+                    index_t j = expired[e] % block_length;
+                    flip_bit(dec, index, block_length, block_weight, k, j);
                     recompute_threshold = 1;
-
-                    fl_remove(dec->fl, fl_pos);
                 }
-                fl_pos = dec->fl->next[fl_pos];
             }
+            dec->fl->bucket_length[current_iter] = 0;
+            dec->fl->length -= n_expired;
         }
     }
 
     // return (!dec->error_weight);
-    return (dec->syndrome_weight == SYNDROME_STOP);
+    return (dec->syndrome_weight == syndrome_stop);
+}
+
+#define DECODE_TTL_PRESET(level, ouroboros, r, d, t)                           \
+    static int decode_ttl_##r(decoder_t dec, int max_iter) {                   \
+        return decode_ttl_body(dec, max_iter, 2, r, d);                        \
+    }
+BIKE_PRESETS(DECODE_TTL_PRESET)
+#undef DECODE_TTL_PRESET
+
+int qcmdpc_decode_ttl(decoder_t dec, int max_iter) {
+    parameters_t params = &dec->params;
+
+#define DECODE_TTL_PRESET(level, ouroboros, r, d, t)                           \
+    if (params->index == 2 && params->block_length == r &&                     \
+        params->block_weight == d)                                             \
+        return decode_ttl_##r(dec, max_iter);
+    BIKE_PRESETS(DECODE_TTL_PRESET)
+#undef DECODE_TTL_PRESET
+
+    return decode_ttl_body(dec, max_iter, params->index, params->block_length,
+                           params->block_weight);
 }
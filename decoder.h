@@ -22,11 +22,27 @@
 #ifndef DECODER_H
 #define DECODER_H
 #include "types.h"
+#include "xoroshiro128plus.h"
 
-void alloc_decoder(decoder_t dec);
+void alloc_decoder(decoder_t dec, parameters_t params);
 void reset_decoder(decoder_t dec);
-void init_decoder_error(decoder_t dec, sparse_t *Hcolumns, sparse_t e_block,
-                        sparse_t e2_block);
+void rand_decoder_key(decoder_t dec, sparse_t *Hcolumns, prng_t prng);
+void init_decoder_error(decoder_t dec, sparse_t e_block, sparse_t e2_block);
+void rand_decoder_error(decoder_t dec, prng_t prng);
+void restart_decoder(decoder_t dec);
+void update_decoder_ttl(decoder_t dec);
 void free_decoder(decoder_t dec);
 int qcmdpc_decode_ttl(decoder_t dec, int max_iter);
+
+static inline int compute_ttl(parameters_t params, int diff) {
+    if (params->ttl_table)
+        return params->ttl_table[(diff < params->ttl_table_length)
+                                     ? diff
+                                     : params->ttl_table_length - 1];
+
+    int ttl = (int)((diff)*params->ttl_coeff0 + params->ttl_coeff1);
+
+    ttl = (ttl < 1) ? 1 : ttl;
+    return (ttl > params->ttl_saturate) ? params->ttl_saturate : ttl;
+}
 #endif
@@ -0,0 +1,149 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <math.h>
+#include <stdlib.h>
+
+#include "importance.h"
+#include "sampling.h"
+
+/* Quantile of the normal distribution for the 95% confidence intervals */
+#define Z_95 1.959963984540054
+
+static double lnbino(unsigned n, unsigned t);
+
+static double lnbino(unsigned n, unsigned t) {
+    if ((t == 0) || (n == t))
+        return 0.0;
+    else
+        return lgamma(n + 1) - lgamma(t + 1) - lgamma(n - t + 1);
+}
+
+/* In characteristic 2, h0^2 = h0(x^2) so that the syndrome of (h0, 0, ...)
+ * has weight block_weight: errors close to it are hard to decode. */
+void overlap_support(parameters_t params, sparse_t *Hcolumns,
+                     sparse_t support) {
+    for (index_t l = 0; l < params->block_weight; ++l) {
+        support[l] = Hcolumns[0][l];
+    }
+}
+
+index_t overlap_min(parameters_t params) {
+    index_t length = params->index * params->block_length;
+    index_t weight = OVERLAP_WEIGHT(params);
+    index_t min = params->error_weight - (length - weight);
+
+    return (min > 0) ? min : 0;
+}
+
+index_t overlap_max(parameters_t params) {
+    index_t weight = OVERLAP_WEIGHT(params);
+
+    return (params->error_weight < weight) ? params->error_weight : weight;
+}
+
+/* Probability (hypergeometric) that a uniformly random error pattern has
+ * 'overlap' positions in common with a given near-codeword. */
+double overlap_probability(parameters_t params, index_t overlap) {
+    index_t length = params->index * params->block_length;
+    index_t weight = OVERLAP_WEIGHT(params);
+    index_t error_weight = params->error_weight;
+
+    return exp(lnbino(weight, overlap) +
+               lnbino(length - weight, error_weight - overlap) -
+               lnbino(length, error_weight));
+}
+
+/* Pick a random error pattern (sorted) with exactly 'overlap' positions in
+ * 'support'. Conditioned on the overlap, it is uniformly distributed. */
+sparse_t overlap_rand(parameters_t params, const sparse_t support,
+                      index_t overlap, prng_t prng, packed_t bitmap,
+                      sparse_t e_block) {
+    const index_t length = params->index * params->block_length;
+    const index_t weight = OVERLAP_WEIGHT(params);
+    const index_t outside = params->error_weight - overlap;
+    index_t in[overlap > 0 ? overlap : 1];
+    index_t out[outside > 0 ? outside : 1];
+
+    sparse_rand(weight, overlap, prng, bitmap, in);
+    sparse_rand(length - weight, outside, prng, bitmap, out);
+
+    /* Turn the ranks outside of the support into positions, then merge
+     * both sorted lists. */
+    index_t s = 0;
+    for (index_t i = 0; i < outside; ++i) {
+        while (s < weight && support[s] <= out[i] + s)
+            ++s;
+        out[i] += s;
+    }
+    index_t i = 0, o = 0;
+    for (index_t n = 0; n < params->error_weight; ++n) {
+        if (o == outside || (i < overlap && support[in[i]] < out[o]))
+            e_block[n] = support[in[i++]];
+        else
+            e_block[n] = out[o++];
+    }
+    return e_block;
+}
+
+/* Wilson score interval of a proportion, [0, 1] without any test. */
+void wilson_interval(long int n, long int failures, double *lower,
+                     double *upper) {
+    if (!n) {
+        *lower = 0.;
+        *upper = 1.;
+        return;
+    }
+    double p = (double)failures / n;
+    double z2 = Z_95 * Z_95;
+    double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    double radius =
+        Z_95 * sqrt(p * (1 - p) / n + z2 / (4. * n * n)) / (1 + z2 / n);
+
+    *lower = (failures && center - radius > 0.) ? center - radius : 0.;
+    *upper = (center + radius < 1.) ? center + radius : 1.;
+}
+
+/* Estimate the failure rate of uniformly random error patterns from the
+ * number of tests and of failures for each overlap (indexed from
+ * overlap_min). Each overlap is weighted by its probability, which is the
+ * likelihood ratio between the uniform and the sampled distributions up to
+ * the constant number of overlaps. The interval adds up the 95% Wilson
+ * intervals of all overlaps, which is conservative. */
+void overlap_estimate(parameters_t params, const long int *n_test,
+                      const long int *n_failure, double *estimate,
+                      double *lower, double *upper) {
+    *estimate = 0.;
+    *lower = 0.;
+    *upper = 0.;
+    for (index_t overlap = overlap_min(params); overlap <= overlap_max(params);
+         ++overlap) {
+        index_t i = overlap - overlap_min(params);
+        double probability = overlap_probability(params, overlap);
+        double p_lower, p_upper;
+
+        wilson_interval(n_test[i], n_failure[i], &p_lower, &p_upper);
+        if (n_test[i])
+            *estimate += probability * n_failure[i] / n_test[i];
+        *lower += probability * p_lower;
+        *upper += probability * p_upper;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef IMPORTANCE_H
+#define IMPORTANCE_H
+#include "types.h"
+#include "xoroshiro128plus.h"
+
+/* Importance sampling of the error patterns: the overlap of the error with a
+ * fixed near-codeword of weight block_weight is drawn uniformly among its
+ * possible values instead of following its hypergeometric distribution, and
+ * each overlap is weighted by its exact probability. Errors close to a
+ * near-codeword are the ones the decoder is most likely to fail on. */
+
+/* Weight of the near-codeword */
+#define OVERLAP_WEIGHT(params) ((params)->block_weight)
+
+/* Support of the near-codeword (h0, 0, ...), the first column of H */
+void overlap_support(parameters_t params, sparse_t *Hcolumns,
+                     sparse_t support);
+index_t overlap_min(parameters_t params);
+index_t overlap_max(parameters_t params);
+double overlap_probability(parameters_t params, index_t overlap);
+sparse_t overlap_rand(parameters_t params, const sparse_t support,
+                      index_t overlap, prng_t prng, packed_t bitmap,
+                      sparse_t e_block);
+void wilson_interval(long int n, long int failures, double *lower,
+                     double *upper);
+void overlap_estimate(parameters_t params, const long int *n_test,
+                      const long int *n_failure, double *estimate,
+                      double *lower, double *upper);
+#endif
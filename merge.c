@@ -0,0 +1,253 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "importance.h"
+#include "output.h"
+#include "stats.h"
+
+/* Merge the binary records written with --output=binary by several shards
+ * of a campaign (the same parameters, mode and seed, different --shard
+ * values), with uniformly sampled error patterns.
+ * The last complete record of each file is taken, and since the shards
+ * decode disjoint instances, their counts are summed and the interval of
+ * the DFR is computed from the sums. */
+
+/* Last record of a file */
+struct shard {
+    const char *path;
+    struct output_header header;
+    /* Numbers of tests and successes of each thread, iteration histogram
+     * and ttl table, as laid out in the file */
+    int64_t *values;
+};
+
+static void print_usage(const char *arg0) {
+    fprintf(stderr,
+            "Usage: %s [OPTIONS] FILE...\n"
+            "Merge the binary records (--output=binary) of the shards of a "
+            "campaign.\n"
+            "\n"
+            "    --output           also write the merged record to stdout as "
+            "JSON (json)\n"
+            "                       or binary (binary)\n",
+            arg0);
+    exit(2);
+}
+
+static long int values_length(const struct output_header *header) {
+    return 2 * header->n_threads + header->max_iter + 1 +
+           header->ttl_table_length;
+}
+
+/* Read the records of a file and keep the last complete one. Returns 1 on
+ * success, 0 if there is none and -1 if the file is not made of records. */
+static int read_last_record(FILE *fp, struct shard *shard) {
+    struct output_header header;
+    int ret = 0;
+    while (fread(&header, sizeof(header), 1, fp) == 1) {
+        if (memcmp(header.magic, OUTPUT_MAGIC, sizeof(header.magic)) ||
+            header.n_threads < 1 || header.max_iter < 0 ||
+            header.ttl_table_length < 0)
+            return -1;
+        const long int length = values_length(&header);
+        int64_t *values = malloc(length * sizeof(int64_t));
+        if (fread(values, sizeof(int64_t), length, fp) != length) {
+            /* Interrupted while writing it */
+            free(values);
+            break;
+        }
+        free(shard->values);
+        shard->header = header;
+        shard->values = values;
+        ret = 1;
+    }
+    return ret;
+}
+
+/* Whether two records were written by shards of the same campaign */
+static int same_campaign(const struct shard *a, const struct shard *b) {
+    const struct output_header *x = &a->header, *y = &b->header;
+    if (x->index != y->index || x->block_length != y->block_length ||
+        x->block_weight != y->block_weight ||
+        x->error_weight != y->error_weight || x->ouroboros != y->ouroboros ||
+        x->ttl_saturate != y->ttl_saturate ||
+        x->ttl_coeff0 != y->ttl_coeff0 || x->ttl_coeff1 != y->ttl_coeff1 ||
+        x->ttl_table_length != y->ttl_table_length ||
+        x->max_iter != y->max_iter || x->mode != y->mode ||
+        x->seed != y->seed)
+        return 0;
+    const long int table = values_length(x) - x->ttl_table_length;
+    return !memcmp(a->values + table, b->values + table,
+                   x->ttl_table_length * sizeof(int64_t));
+}
+
+int main(int argc, char *argv[]) {
+    int output_format = OUTPUT_TEXT;
+    static struct option longopts[] = {
+        {"output", required_argument, 0, 'O'}, {0, 0, 0, 0}};
+    int ch;
+    while ((ch = getopt_long(argc, argv, "", longopts, NULL)) != -1) {
+        if (ch != 'O')
+            print_usage(argv[0]);
+        if (!strcmp(optarg, "json"))
+            output_format = OUTPUT_JSON;
+        else if (!strcmp(optarg, "binary"))
+            output_format = OUTPUT_BINARY;
+        else if (strcmp(optarg, "text"))
+            print_usage(argv[0]);
+    }
+    const int n_shards = argc - optind;
+    if (n_shards < 1)
+        print_usage(argv[0]);
+
+    struct shard *shards = calloc(n_shards, sizeof(struct shard));
+    for (int i = 0; i < n_shards; ++i) {
+        shards[i].path = argv[optind + i];
+        FILE *fp = fopen(shards[i].path, "rb");
+        if (!fp) {
+            fprintf(stderr, "Cannot open '%s'.\n", shards[i].path);
+            exit(EXIT_FAILURE);
+        }
+        int read = read_last_record(fp, &shards[i]);
+        fclose(fp);
+        if (read <= 0) {
+            fprintf(stderr,
+                    read ? "'%s' is not made of binary records.\n"
+                         : "'%s' holds no complete record.\n",
+                    shards[i].path);
+            exit(EXIT_FAILURE);
+        }
+        /* The counts of importance sampling and of sweeps are not those of
+         * uniformly random error patterns at the error weight. */
+        if (!MODE_UNIFORM(shards[i].header.mode)) {
+            fprintf(stderr,
+                    "'%s' is not from uniformly sampled error patterns.\n",
+                    shards[i].path);
+            exit(EXIT_FAILURE);
+        }
+        for (int j = 0; j < i; ++j) {
+            if (!same_campaign(&shards[i], &shards[j])) {
+                fprintf(stderr,
+                        "'%s' and '%s' are not from the same parameters, "
+                        "mode and seed.\n",
+                        shards[j].path, shards[i].path);
+                exit(EXIT_FAILURE);
+            }
+            /* The same instances would be counted twice. */
+            if (shards[i].header.shard == shards[j].header.shard) {
+                fprintf(stderr, "'%s' and '%s' are both shard %" PRId64 ".\n",
+                        shards[j].path, shards[i].path,
+                        shards[i].header.shard);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    const struct output_header *first = &shards[0].header;
+    const int max_iter = first->max_iter;
+    const long int table = values_length(first) - first->ttl_table_length;
+    uint8_t *ttl_table = NULL;
+    struct parameters params = {.index = first->index,
+                                .block_length = first->block_length,
+                                .block_weight = first->block_weight,
+                                .error_weight = first->error_weight,
+                                .ouroboros = first->ouroboros,
+                                .ttl_coeff0 = first->ttl_coeff0,
+                                .ttl_coeff1 = first->ttl_coeff1,
+                                .ttl_saturate = first->ttl_saturate};
+    if (first->ttl_table_length) {
+        ttl_table = malloc(first->ttl_table_length);
+        for (long int i = 0; i < first->ttl_table_length; ++i) {
+            ttl_table[i] = shards[0].values[table + i];
+        }
+        params.ttl_table = ttl_table;
+        params.ttl_table_length = first->ttl_table_length;
+    }
+
+    /* Each shard is reported as one thread of the merged record. */
+    stats_t total = stats_new(max_iter, 0, 0, 0);
+    stats_t *totals = malloc(n_shards * sizeof(stats_t));
+    double elapsed = 0., throughput = 0.;
+    int final = 1;
+    for (int i = 0; i < n_shards; ++i) {
+        const struct output_header *header = &shards[i].header;
+        const int64_t *iter = shards[i].values + 2 * header->n_threads;
+        totals[i] = stats_new(max_iter, 0, 0, 0);
+        *totals[i]->n_test = header->n_test;
+        *totals[i]->n_success = header->n_success;
+        *total->n_test += header->n_test;
+        *total->n_success += header->n_success;
+        for (int it = 0; it <= max_iter; ++it) {
+            total->n_iter[it] += iter[it];
+        }
+        if (header->elapsed > elapsed)
+            elapsed = header->elapsed;
+        throughput += header->throughput;
+        final = final && header->final;
+
+        fprintf(stderr, "Shard %" PRId64 ": %" PRId64 " tests, %" PRId64
+                        " failures%s\n",
+                header->shard, header->n_test,
+                header->n_test - header->n_success,
+                header->final ? "" : " (not finished)");
+    }
+
+    fprintf(stderr, "%ld", *total->n_test);
+    for (int it = 0; it <= max_iter; ++it) {
+        if (total->n_iter[it])
+            fprintf(stderr, " %d:%ld", it, total->n_iter[it]);
+    }
+    if (*total->n_success != *total->n_test)
+        fprintf(stderr, " >%d:%ld", max_iter,
+                *total->n_test - *total->n_success);
+    fprintf(stderr, "\n");
+    const long int n_failure = *total->n_test - *total->n_success;
+    double lower, upper;
+    wilson_interval(*total->n_test, n_failure, &lower, &upper);
+    fprintf(stderr, "DFR: %e, 95%% interval: [%e, %e]\n",
+            *total->n_test ? (double)n_failure / *total->n_test : 0., lower,
+            upper);
+
+    /* The merged record has the shard -1. */
+    if (output_format != OUTPUT_TEXT)
+        if (!output_record(stdout, output_format, &params, max_iter,
+                           first->mode, 0, NULL, first->seed, -1, total,
+                           totals, n_shards, elapsed, throughput, final)) {
+            fprintf(stderr, "Could not write the merged record.\n");
+            exit(EXIT_FAILURE);
+        }
+
+    for (int i = 0; i < n_shards; ++i) {
+        free(totals[i]);
+        free(shards[i].values);
+    }
+    free(totals);
+    free(total);
+    free(shards);
+    free(ttl_table);
+    exit(EXIT_SUCCESS);
+}
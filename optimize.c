@@ -0,0 +1,266 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "optimize.h"
+
+/* Minimum number of tests before the DFR of a ttl function is trusted */
+#define MIN_TEST 1000
+/* Width of the 95% interval (as log10(upper) - log10(lower)) at which the
+ * evaluation of a ttl function stops */
+#define PRECISION 1e-1
+/* Quantile of the normal distribution for the 95% confidence intervals */
+#define Z_95 1.959963984540054
+/* Number of tests between two checks of the interval */
+#define CHUNK 1000
+
+/* Nelder-Mead, with the adaptive coefficients of Gao and Han for dimension
+ * 2 and the default tolerances of scipy. */
+#define DIM 2
+#define NM_REFLECT 1.
+#define NM_EXPAND (1. + 2. / DIM)
+#define NM_CONTRACT (0.75 - 1. / (2 * DIM))
+#define NM_SHRINK (1. - 1. / DIM)
+#define NM_XATOL 1e-4
+#define NM_FATOL 1e-4
+#define NM_MAX_EVAL (200 * DIM)
+
+/* Number of tests and failures of the ttl functions already evaluated, keyed
+ * by their values: different coefficients often give the same integer ttl
+ * for all relevant counters. */
+struct ttl_result {
+    uint8_t *ttl;
+    long int n_test;
+    long int n_failure;
+};
+
+struct optimizer {
+    struct parameters params;
+    long int max_test;
+    ttl_evaluator_t evaluator;
+    void *arg;
+    /* Number of relevant ttl values (counters above the threshold by at most
+     * half the block weight) */
+    index_t n_ttl;
+    struct ttl_result *results;
+    index_t n_results;
+    /* Smallest upper bound of the DFR of an accurately evaluated function */
+    double best_upper;
+};
+
+static void wilson_cc(long int n, long int failures, double *lower,
+                      double *upper);
+static struct ttl_result *find_result(struct optimizer *opt);
+static double evaluate(struct optimizer *opt, const double *x);
+static void sort_simplex(double sim[DIM + 1][DIM], double *fsim);
+
+/* Wilson score interval with continuity correction, [0, 1] when it is not
+ * defined. */
+static void wilson_cc(long int n, long int failures, double *lower,
+                      double *upper) {
+    *lower = 0.;
+    *upper = 1.;
+    if (n <= 0)
+        return;
+    double p = (double)failures / n;
+    double z2 = Z_95 * Z_95;
+    double minus = z2 - 1. / n + 4 * n * p * (1 - p) + (4 * p - 2);
+    double plus = z2 - 1. / n + 4 * n * p * (1 - p) - (4 * p - 2);
+    if (minus < 0)
+        return;
+    *lower = (2 * n * p + z2 - Z_95 * sqrt(minus) + 1) / (2 * (n + z2));
+    *lower = (*lower > 0.) ? *lower : 0.;
+    if (plus >= 0) {
+        *upper = (2 * n * p + z2 + Z_95 * sqrt(plus) + 1) / (2 * (n + z2));
+        *upper = (*upper < 1.) ? *upper : 1.;
+    }
+}
+
+static struct ttl_result *find_result(struct optimizer *opt) {
+    uint8_t ttl[opt->n_ttl];
+    for (index_t diff = 0; diff < opt->n_ttl; ++diff) {
+        ttl[diff] = compute_ttl(&opt->params, diff);
+    }
+    for (index_t i = 0; i < opt->n_results; ++i) {
+        if (!memcmp(opt->results[i].ttl, ttl, opt->n_ttl))
+            return &opt->results[i];
+    }
+    opt->results = realloc(opt->results,
+                           (opt->n_results + 1) * sizeof(struct ttl_result));
+    struct ttl_result *result = &opt->results[opt->n_results++];
+    result->ttl = malloc(opt->n_ttl);
+    memcpy(result->ttl, ttl, opt->n_ttl);
+    result->n_test = 0;
+    result->n_failure = 0;
+    return result;
+}
+
+/* DFR of the ttl function of coefficients 'x'. Tests are added until the
+ * interval is narrow enough, or until the function is known to be worse than
+ * the best one. Previous tests of the same ttl values are reused. */
+static double evaluate(struct optimizer *opt, const double *x) {
+    opt->params.ttl_coeff0 = x[0];
+    opt->params.ttl_coeff1 = x[1];
+    struct ttl_result *result = find_result(opt);
+
+    while (opt->max_test <= 0 || result->n_test < opt->max_test) {
+        double lower, upper;
+        wilson_cc(result->n_test, result->n_failure, &lower, &upper);
+        if (lower > 0.) {
+            if (log10(upper) - log10(lower) < PRECISION &&
+                result->n_test > MIN_TEST) {
+                if (upper < opt->best_upper)
+                    opt->best_upper = upper;
+                break;
+            }
+            if (lower > opt->best_upper)
+                break;
+        }
+        result->n_failure += opt->evaluator(&opt->params, CHUNK, opt->arg);
+        result->n_test += CHUNK;
+    }
+
+    double dfr =
+        result->n_test ? (double)result->n_failure / result->n_test : 1.;
+    fprintf(stderr, "%f %f %e %ld %ld\n", x[0], x[1], dfr, result->n_test,
+            result->n_failure);
+    return dfr;
+}
+
+static void sort_simplex(double sim[DIM + 1][DIM], double *fsim) {
+    for (int i = 1; i <= DIM; ++i) {
+        for (int j = i; j > 0 && fsim[j] < fsim[j - 1]; --j) {
+            double f = fsim[j];
+            fsim[j] = fsim[j - 1];
+            fsim[j - 1] = f;
+            for (int k = 0; k < DIM; ++k) {
+                double v = sim[j][k];
+                sim[j][k] = sim[j - 1][k];
+                sim[j - 1][k] = v;
+            }
+        }
+    }
+}
+
+/* Minimize the DFR over the coefficients of the ttl function with the
+ * Nelder-Mead method, starting from a simplex randomly spread around (1, 1.5)
+ * as optimize-ttl.py did. The best coefficients are written in 'params'. */
+void optimize_ttl(parameters_t params, long int max_test,
+                  ttl_evaluator_t evaluator, void *arg, prng_t prng) {
+    static const double x0[DIM] = {1., 1.5};
+    static const double spread[DIM] = {0.75, 0.95};
+    struct optimizer opt = {*params, max_test, evaluator, arg,
+                            params->block_weight / 2 + 1, NULL, 0, 1.};
+
+    double sim[DIM + 1][DIM];
+    double fsim[DIM + 1];
+    for (int i = 0; i <= DIM; ++i) {
+        for (int k = 0; k < DIM; ++k) {
+            double u = (prng_uint64_t(prng) >> 11) * 0x1p-53;
+            sim[i][k] = x0[k] + spread[k] * (1 - 2 * u);
+        }
+        fsim[i] = evaluate(&opt, sim[i]);
+    }
+    int n_eval = DIM + 1;
+    sort_simplex(sim, fsim);
+
+    while (n_eval < NM_MAX_EVAL) {
+        double xdiff = 0., fdiff = 0.;
+        for (int i = 1; i <= DIM; ++i) {
+            for (int k = 0; k < DIM; ++k) {
+                xdiff = fmax(xdiff, fabs(sim[i][k] - sim[0][k]));
+            }
+            fdiff = fmax(fdiff, fabs(fsim[i] - fsim[0]));
+        }
+        if (xdiff <= NM_XATOL && fdiff <= NM_FATOL)
+            break;
+
+        double xbar[DIM] = {0.}, xr[DIM], xe[DIM], xc[DIM];
+        for (int i = 0; i < DIM; ++i) {
+            for (int k = 0; k < DIM; ++k) {
+                xbar[k] += sim[i][k] / DIM;
+            }
+        }
+        for (int k = 0; k < DIM; ++k) {
+            xr[k] = (1 + NM_REFLECT) * xbar[k] - NM_REFLECT * sim[DIM][k];
+        }
+        double fxr = evaluate(&opt, xr);
+        ++n_eval;
+
+        int shrink = 0;
+        if (fxr < fsim[0]) {
+            for (int k = 0; k < DIM; ++k) {
+                xe[k] = (1 + NM_REFLECT * NM_EXPAND) * xbar[k] -
+                        NM_REFLECT * NM_EXPAND * sim[DIM][k];
+            }
+            double fxe = evaluate(&opt, xe);
+            ++n_eval;
+            memcpy(sim[DIM], (fxe < fxr) ? xe : xr, sizeof(xr));
+            fsim[DIM] = (fxe < fxr) ? fxe : fxr;
+        }
+        else if (fxr < fsim[DIM - 1]) {
+            memcpy(sim[DIM], xr, sizeof(xr));
+            fsim[DIM] = fxr;
+        }
+        else {
+            /* Contraction outside of the simplex if the reflected point is
+             * better than the worst one, inside otherwise */
+            int outside = fxr < fsim[DIM];
+            for (int k = 0; k < DIM; ++k) {
+                xc[k] = outside ? (1 + NM_CONTRACT * NM_REFLECT) * xbar[k] -
+                                      NM_CONTRACT * NM_REFLECT * sim[DIM][k]
+                                : (1 - NM_CONTRACT) * xbar[k] +
+                                      NM_CONTRACT * sim[DIM][k];
+            }
+            double fxc = evaluate(&opt, xc);
+            ++n_eval;
+            if (outside ? fxc <= fxr : fxc < fsim[DIM]) {
+                memcpy(sim[DIM], xc, sizeof(xc));
+                fsim[DIM] = fxc;
+            }
+            else {
+                shrink = 1;
+            }
+        }
+        if (shrink) {
+            for (int i = 1; i <= DIM; ++i) {
+                for (int k = 0; k < DIM; ++k) {
+                    sim[i][k] = sim[0][k] + NM_SHRINK * (sim[i][k] - sim[0][k]);
+                }
+                fsim[i] = evaluate(&opt, sim[i]);
+                ++n_eval;
+            }
+        }
+        sort_simplex(sim, fsim);
+    }
+
+    params->ttl_coeff0 = sim[0][0];
+    params->ttl_coeff1 = sim[0][1];
+    for (index_t i = 0; i < opt.n_results; ++i) {
+        free(opt.results[i].ttl);
+    }
+    free(opt.results);
+}
@@ -0,0 +1,192 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "importance.h"
+#include "output.h"
+#include "sweep.h"
+
+/* Names of the MODE_* flags, from the lowest bit */
+static const char *mode_names[] = {"importance_sampling", "sweep",
+                                   "compare_ttl", "batch"};
+
+static void output_json(FILE *fp, parameters_t params, int max_iter,
+                        int mode, uint64_t seed, long int shard,
+                        stats_t total, stats_t const *threads, int n_threads,
+                        double elapsed, double throughput, int final,
+                        int has_dfr, double dfr, double lower,
+                        double upper) {
+    fprintf(fp,
+            "{\"index\":%ld,\"block_length\":%ld,\"block_weight\":%ld,"
+            "\"error_weight\":%ld,\"ouroboros\":%d,\"ttl_coeff0\":%.17g,"
+            "\"ttl_coeff1\":%.17g,\"ttl_saturate\":%d",
+            (long int)params->index, (long int)params->block_length,
+            (long int)params->block_weight, (long int)params->error_weight,
+            params->ouroboros, params->ttl_coeff0, params->ttl_coeff1,
+            params->ttl_saturate);
+    if (params->ttl_table) {
+        fprintf(fp, ",\"ttl_table\":[");
+        for (index_t i = 0; i < params->ttl_table_length; ++i) {
+            fprintf(fp, i ? ",%d" : "%d", params->ttl_table[i]);
+        }
+        fprintf(fp, "]");
+    }
+    fprintf(fp, ",\"mode\":[");
+    for (int i = 0, n = 0; i < sizeof(mode_names) / sizeof(*mode_names);
+         ++i) {
+        if (mode & (1 << i))
+            fprintf(fp, n++ ? ",\"%s\"" : "\"%s\"", mode_names[i]);
+    }
+    /* The seed is a string since JSON numbers are often read as doubles. */
+    fprintf(fp,
+            "],\"max_iter\":%d,\"seed\":\"%#" PRIx64
+            "\",\"shard\":%ld,\"final\":%s,\"elapsed\":%.3f",
+            max_iter, seed, shard, final ? "true" : "false", elapsed);
+    fprintf(fp, ",\"threads\":[");
+    for (int t = 0; t < n_threads; ++t) {
+        fprintf(fp, "%s{\"n_test\":%ld,\"n_success\":%ld}", t ? "," : "",
+                *threads[t]->n_test, *threads[t]->n_success);
+    }
+    fprintf(fp, "],\"n_test\":%ld,\"n_success\":%ld,\"n_iter\":[",
+            *total->n_test, *total->n_success);
+    for (int it = 0; it <= max_iter; ++it) {
+        fprintf(fp, it ? ",%ld" : "%ld", total->n_iter[it]);
+    }
+    fprintf(fp, "]");
+    /* Left out until a sweep has enough points for a fit */
+    if (has_dfr)
+        fprintf(fp, ",\"dfr\":%.17g,\"dfr_lower\":%.17g,\"dfr_upper\":%.17g",
+                dfr, lower, upper);
+    fprintf(fp, ",\"throughput\":%.17g}\n", throughput);
+}
+
+/* Returns 1 if the whole record was written, 0 otherwise. */
+static int output_binary(FILE *fp, parameters_t params, int max_iter,
+                         int mode, uint64_t seed, long int shard,
+                         stats_t total, stats_t const *threads, int n_threads,
+                         double elapsed, double throughput, int final,
+                         int has_dfr, double dfr, double lower,
+                         double upper) {
+    const index_t table_length =
+        params->ttl_table ? params->ttl_table_length : 0;
+    struct output_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OUTPUT_MAGIC, sizeof(header.magic));
+    header.seed = seed;
+    header.shard = shard;
+    header.index = params->index;
+    header.block_length = params->block_length;
+    header.block_weight = params->block_weight;
+    header.error_weight = params->error_weight;
+    header.ouroboros = params->ouroboros;
+    header.ttl_saturate = params->ttl_saturate;
+    header.ttl_table_length = table_length;
+    header.max_iter = max_iter;
+    header.mode = mode;
+    header.n_threads = n_threads;
+    header.final = final;
+    header.n_test = *total->n_test;
+    header.n_success = *total->n_success;
+    header.ttl_coeff0 = params->ttl_coeff0;
+    header.ttl_coeff1 = params->ttl_coeff1;
+    header.elapsed = elapsed;
+    header.throughput = throughput;
+    header.has_dfr = has_dfr;
+    header.dfr = dfr;
+    header.dfr_lower = lower;
+    header.dfr_upper = upper;
+
+    const long int length = 2 * n_threads + max_iter + 1 + table_length;
+    int64_t values[length];
+    int64_t *v = values;
+    for (int t = 0; t < n_threads; ++t) {
+        *v++ = *threads[t]->n_test;
+    }
+    for (int t = 0; t < n_threads; ++t) {
+        *v++ = *threads[t]->n_success;
+    }
+    for (int it = 0; it <= max_iter; ++it) {
+        *v++ = total->n_iter[it];
+    }
+    for (index_t i = 0; i < table_length; ++i) {
+        *v++ = params->ttl_table[i];
+    }
+    return fwrite(&header, sizeof(header), 1, fp) == 1 &&
+           fwrite(values, sizeof(int64_t), length, fp) == length;
+}
+
+/* Estimate of the DFR at the error weight of 'params' and its 95% interval
+ * according to the mode of the run. Returns 0 if there is none yet (and sets
+ * them to 0). */
+static int output_estimate(parameters_t params, int mode, index_t n_weights,
+                            const index_t *weights, stats_t total,
+                            double *dfr, double *lower, double *upper) {
+    if (mode & MODE_IMPORTANCE_SAMPLING) {
+        overlap_estimate(params, total->n_overlap_test,
+                         total->n_overlap_failure, dfr, lower, upper);
+    }
+    else if (mode & MODE_SWEEP) {
+        struct sweep_fit fit;
+        if (!sweep_fit(n_weights, weights, total->n_weight_test,
+                       total->n_weight_failure, &fit)) {
+            *dfr = *lower = *upper = 0.;
+            return 0;
+        }
+        sweep_predict(&fit, params->error_weight, dfr, lower, upper);
+        *dfr = exp(*dfr);
+        *lower = exp(*lower);
+        *upper = exp(*upper);
+    }
+    else {
+        const long int n_failure = *total->n_test - *total->n_success;
+        *dfr = *total->n_test ? (double)n_failure / *total->n_test : 0.;
+        wilson_interval(*total->n_test, n_failure, lower, upper);
+    }
+    return 1;
+}
+
+/* Write a record with the counters 'total' of all threads and those of each
+ * thread, and flush it so that it can be read as soon as it is written.
+ * 'weights' are the error weights of a sweep. Returns 1 on success, 0 if the
+ * record could not be written. */
+int output_record(FILE *fp, enum output_format format, parameters_t params,
+                  int max_iter, int mode, index_t n_weights,
+                  const index_t *weights, uint64_t seed, long int shard,
+                  stats_t total, stats_t const *threads, int n_threads,
+                  double elapsed, double throughput, int final) {
+    double dfr, lower, upper;
+    const int has_dfr = output_estimate(params, mode, n_weights, weights,
+                                        total, &dfr, &lower, &upper);
+
+    int ret = 1;
+    if (format == OUTPUT_JSON)
+        output_json(fp, params, max_iter, mode, seed, shard, total, threads,
+                    n_threads, elapsed, throughput, final, has_dfr, dfr, lower,
+                    upper);
+    else if (format == OUTPUT_BINARY)
+        ret = output_binary(fp, params, max_iter, mode, seed, shard, total,
+                            threads, n_threads, elapsed, throughput, final,
+                            has_dfr, dfr, lower, upper);
+    return fflush(fp) == 0 && !ferror(fp) && ret;
+}
@@ -0,0 +1,90 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stdio.h>
+
+#include "stats.h"
+#include "types.h"
+
+/* Snapshots of the statistics written to stdout for other programs, in
+ * addition to the text reports on stderr */
+enum output_format { OUTPUT_TEXT, OUTPUT_JSON, OUTPUT_BINARY };
+
+/* Flags of the mode of a run. Without MODE_IMPORTANCE_SAMPLING nor
+ * MODE_SWEEP, the error patterns are drawn uniformly and the numbers of tests
+ * and successes are those of the error weight of the parameters (of the
+ * first candidate with MODE_COMPARE_TTL). */
+#define MODE_IMPORTANCE_SAMPLING 1
+#define MODE_SWEEP 2
+#define MODE_COMPARE_TTL 4
+#define MODE_BATCH 8
+#define MODE_UNIFORM(mode) (!((mode) & (MODE_IMPORTANCE_SAMPLING | MODE_SWEEP)))
+
+/* A binary record is a 'struct output_header' followed by 'n_threads'
+ * numbers of tests, 'n_threads' numbers of successes, the 'max_iter + 1'
+ * counts of the iteration histogram and the 'ttl_table_length' values of the
+ * ttl table, all as int64_t in native byte order. */
+#define OUTPUT_MAGIC "QCMDPCR4"
+struct output_header {
+    char magic[8];
+    /* Seed of the PRNG and shard of the stream of that seed */
+    uint64_t seed;
+    int64_t shard;
+    int64_t index;
+    int64_t block_length;
+    int64_t block_weight;
+    int64_t error_weight;
+    int64_t ouroboros;
+    int64_t ttl_saturate;
+    int64_t ttl_table_length;
+    int64_t max_iter;
+    /* MODE_* flags */
+    int64_t mode;
+    int64_t n_threads;
+    /* Non zero for the last record of the run */
+    int64_t final;
+    int64_t n_test;
+    int64_t n_success;
+    /* Non zero if there is an estimate of the DFR (in a sweep, once there
+     * are enough points for a fit) */
+    int64_t has_dfr;
+    double ttl_coeff0;
+    double ttl_coeff1;
+    /* Seconds since the decoding started, and tests per second */
+    double elapsed;
+    double throughput;
+    /* Estimate of the DFR at the error weight of the parameters and its 95%
+     * interval: the failure rate and its Wilson score interval for uniform
+     * sampling, the reweighted estimate with importance sampling and the
+     * extrapolation of the fit in a sweep (0 without an estimate) */
+    double dfr;
+    double dfr_lower;
+    double dfr_upper;
+};
+
+int output_record(FILE *fp, enum output_format format, parameters_t params,
+                  int max_iter, int mode, index_t n_weights,
+                  const index_t *weights, uint64_t seed, long int shard,
+                  stats_t total, stats_t const *threads, int n_threads,
+                  double elapsed, double throughput, int final);
+#endif
@@ -0,0 +1,107 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <stddef.h>
+
+#include "param.h"
+
+void parameters_default(parameters_t params) {
+#ifdef PRESET
+    parameters_preset(params, PRESET, OUROBOROS);
+#endif
+    params->index = INDEX;
+#ifdef BLOCK_LENGTH
+    params->block_length = BLOCK_LENGTH;
+#endif
+#ifdef BLOCK_WEIGHT
+    params->block_weight = BLOCK_WEIGHT;
+#endif
+#ifdef ERROR_WEIGHT
+    params->error_weight = ERROR_WEIGHT;
+#endif
+    params->ouroboros = OUROBOROS;
+#ifdef SYNDROME_STOP
+    params->syndrome_stop = SYNDROME_STOP;
+#else
+    params->syndrome_stop = OUROBOROS ? params->error_weight / 2 : 0;
+#endif
+    params->ttl_coeff0 = TTL_COEFF0;
+    params->ttl_coeff1 = TTL_COEFF1;
+    params->ttl_saturate = TTL_SATURATE;
+    params->ttl_table = NULL;
+    params->ttl_table_length = 0;
+}
+
+/* Set the code parameters of a BIKE security level. Returns 0 if there is no
+ * such preset. */
+int parameters_preset(parameters_t params, int level, int ouroboros) {
+#define PRESET_CASE(l, o, r, d, t)                                             \
+    if (level == l && !ouroboros == !o) {                                      \
+        params->index = 2;                                                     \
+        params->block_length = r;                                              \
+        params->block_weight = d;                                              \
+        params->error_weight = t;                                              \
+        params->ouroboros = o;                                                 \
+        params->syndrome_stop = o ? t / 2 : 0;                                 \
+        return 1;                                                              \
+    }
+    BIKE_PRESETS(PRESET_CASE)
+#undef PRESET_CASE
+    return 0;
+}
+
+/* Change the error weight, and the syndrome weight at which Ouroboros
+ * decoding stops accordingly. */
+void parameters_error_weight(parameters_t params, index_t error_weight) {
+    params->error_weight = error_weight;
+    params->syndrome_stop = params->ouroboros ? error_weight / 2 : 0;
+}
+
+/* Returns NULL if the parameters are supported, an error message otherwise. */
+const char *parameters_check(parameters_t params) {
+    if (params->index < 1)
+        return "INDEX must be at least 1";
+    if (params->block_length < 2)
+        return "BLOCK_LENGTH must be at least 2";
+    if (params->block_weight < 1 ||
+        params->block_weight > params->block_length)
+        return "BLOCK_WEIGHT must be between 1 and BLOCK_LENGTH";
+    if (params->error_weight < 1 ||
+        params->error_weight > params->index * params->block_length)
+        return "ERROR_WEIGHT must be between 1 and INDEX * BLOCK_LENGTH";
+    /* Counters are at most 16 bits wide, positions are 32-bit indices. */
+    if (params->block_weight > 65535)
+        return "BLOCK_WEIGHT > 65535: Not implemented";
+    if ((int64_t)params->index * params->block_length > INT32_MAX)
+        return "INDEX * BLOCK_LENGTH > 2^31 - 1: Not implemented";
+    if (params->syndrome_stop < 0 ||
+        params->syndrome_stop > params->block_length)
+        return "SYNDROME_STOP must be between 0 and BLOCK_LENGTH";
+    if (params->ttl_saturate < 1 || params->ttl_saturate > 255)
+        return "TTL_SATURATE must be between 1 and 255";
+    for (index_t i = 0; params->ttl_table && i < params->ttl_table_length;
+         ++i) {
+        if (params->ttl_table[i] < 1 ||
+            params->ttl_table[i] > params->ttl_saturate)
+            return "The ttl table values must be between 1 and TTL_SATURATE";
+    }
+    return NULL;
+}
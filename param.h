@@ -21,6 +21,10 @@
 */
 #ifndef PARAM_H
 #define PARAM_H
+#include "types.h"
+
+/* Parameters are chosen at runtime, the macros below only give their default
+ * values. */
 #if !defined(PRESET) && !(defined(INDEX) && defined(BLOCK_LENGTH) &&           \
                           defined(BLOCK_WEIGHT) && defined(ERROR_WEIGHT))
 #define PRESET 256
@@ -28,94 +32,9 @@
 #ifndef OUROBOROS
 #define OUROBOROS 0
 #endif
-
-#ifdef PRESET
-#if PRESET == 128 && !OUROBOROS
-#ifndef INDEX
-#define INDEX 2
-#endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 10163
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 134
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 71
-#endif
-#elif PRESET == 128 && OUROBOROS
-#ifndef INDEX
-#define INDEX 2
-#endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 11027
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 154
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 67
-#endif
-#elif PRESET == 192 && !OUROBOROS
 #ifndef INDEX
 #define INDEX 2
 #endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 19853
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 199
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 103
-#endif
-#elif PRESET == 192 && OUROBOROS
-#ifndef INDEX
-#define INDEX 2
-#endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 21683
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 226
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 99
-#endif
-#elif PRESET == 256 && !OUROBOROS
-#ifndef INDEX
-#define INDEX 2
-#endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 32749
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 264
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 137
-#endif
-#elif PRESET == 256 && OUROBOROS
-#ifndef INDEX
-#define INDEX 2
-#endif
-#ifndef BLOCK_LENGTH
-#define BLOCK_LENGTH 36131
-#endif
-#ifndef ERROR_WEIGHT
-#define ERROR_WEIGHT 300
-#endif
-#ifndef BLOCK_WEIGHT
-#define BLOCK_WEIGHT 133
-#endif
-#endif
-#endif
-
-#if OUROBOROS && !defined(SYNDROME_STOP)
-#define SYNDROME_STOP ((ERROR_WEIGHT) / 2)
-#else
-#define SYNDROME_STOP 0
-#endif
 
 #ifndef TTL_COEFF0
 #define TTL_COEFF0 0.435
@@ -127,13 +46,18 @@
 #define TTL_SATURATE 5
 #endif
 
-#if INDEX != 2
-#error "INDEX != 2: Not implemented"
-#endif
-#if BLOCK_WEIGHT > 255
-#error "BLOCK_WEIGHT > 255: Not implemented"
-#endif
-#if BLOCK_LENGTH > 65536
-#error "BLOCK_LENGTH > 65536: Not implemented"
-#endif
+/* BIKE parameters as X(security level, Ouroboros, BLOCK_LENGTH, BLOCK_WEIGHT,
+ * ERROR_WEIGHT). The decoder has specialised versions for each of them. */
+#define BIKE_PRESETS(X)                                                        \
+    X(128, 0, 10163, 71, 134)                                                  \
+    X(128, 1, 11027, 67, 154)                                                  \
+    X(192, 0, 19853, 103, 199)                                                 \
+    X(192, 1, 21683, 99, 226)                                                  \
+    X(256, 0, 32749, 137, 264)                                                 \
+    X(256, 1, 36131, 133, 300)
+
+void parameters_default(parameters_t params);
+int parameters_preset(parameters_t params, int level, int ouroboros);
+void parameters_error_weight(parameters_t params, index_t error_weight);
+const char *parameters_check(parameters_t params);
 #endif
@@ -19,181 +19,929 @@
    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
    IN THE SOFTWARE
 */
+#include <inttypes.h>
+#include <math.h>
 #include <omp.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "batch.h"
+#include "checkpoint.h"
 #include "cli.h"
 #include "decoder.h"
+#include "importance.h"
+#include "optimize.h"
+#include "output.h"
 #include "param.h"
+#include "sampling.h"
 #include "sparse_cyclic.h"
+#include "stats.h"
+#include "sweep.h"
+#include "threshold.h"
 
 /* In seconds */
 #define TIME_BETWEEN_PRINTS 5
-
-static void print_parameters(void);
-static void print_stats(long int *n_test, long int *n_success);
-static void inthandler(int signo);
-
-static long int *n_test = NULL;
-static long int *n_success = NULL;
-static long int **n_iter = NULL;
+/* Minimum number of tests handed out to a thread at once */
+#define CHUNK_TESTS 64
+/* Number of tests per epoch of the sweep schedule (rounded down to whole
+ * chunks, at least one), and minimum number of epochs of a bounded run */
+#define SWEEP_EPOCH_TESTS 16384
+#define SWEEP_MIN_EPOCHS 8
+
+/* Statistics of the decodings made with the current parity check matrix */
+struct key_stats {
+    long int index;
+    /* End of the chunk of keys of the thread */
+    long int chunk_end;
+    /* Number of tests of the key (fewer for the last key of a run) */
+    long int length;
+    /* Start of the substream of the key 'index' */
+    uint64_t s0, s1;
+    long int n_test;
+    long int n_success;
+    long int *n_iter;
+    /* In a sweep, number of tests and failures of each error weight */
+    long int *n_weight_test;
+    long int *n_weight_failure;
+};
+
+/* State of a thread decoding random instances for the ttl optimizer */
+struct worker {
+    sparse_t *H;
+    struct decoder dec;
+    struct PRNG prng;
+};
+
+static void print_parameters(parameters_t params);
+static void print_histogram(long int n_test, long int n_success,
+                            const long int *n_iter);
+static void print_stats(stats_t total);
+static void wait_schedule(long int key);
+static int start_key(int tid, struct key_stats *key, const uint64_t *stream,
+                     prng_t prng);
+static void end_key(int tid, struct key_stats *key);
+static long int run_workers(parameters_t ttl_params, long int n,
+                            void *workers);
+static int decode_candidates(decoder_t dec, int *failed);
+static void print_comparison(stats_t total);
+static void print_estimate(stats_t total);
+static void print_overlaps(stats_t total);
+static void print_fit(stats_t total, int verbose);
+static void print_sweep(stats_t total);
+static void save_thresholds(void);
+static void save_checkpoint(void);
+static stats_t stats_new_total(void);
+static void report(int final);
+static void *reporter(void *arg);
+
+/* Statistics of each thread, NULL until the decoding starts */
+static stats_t *stats = NULL;
+/* Reported per key if non zero */
+static long int errors_per_key = 0;
+static int importance_sampling = 0;
+static struct parameters params;
+/* With --compare-ttl, ttl coefficients of the candidates */
+static int n_candidates = 0;
+static double *candidates = NULL;
+/* With a sweep, error weights */
+static index_t n_weights = 0;
+static index_t *weights = NULL;
+/* With a sweep, choice of the weight of the tests of each key (under
+ * 'schedule_lock') */
+static sweep_schedule_t schedule = NULL;
 static int n_threads = 1;
 static int max_iter = 100;
-
-static void print_parameters(void) {
+static int quiet = 0;
+/* SIGINT and SIGHUP, blocked in all threads, are read by the reporter thread
+ * from 'signal_fd'. Writing to 'stop_fd' ends the reporter thread. */
+static int signal_fd = -1;
+static int stop_fd = -1;
+static int output_format = OUTPUT_TEXT;
+/* MODE_* flags of the run */
+static int mode = 0;
+/* When the decoding started, for the throughput */
+static struct timespec start_time;
+static threshold_table_t thresholds = NULL;
+static const char *threshold_file = NULL;
+/* With --checkpoint, the state of the threads is saved at each key boundary
+ * and written to this file with the reports */
+static const char *checkpoint_file = NULL;
+/* Number of tests decoded with each parity check matrix */
+static long int key_size = 1;
+/* What the run decodes, to check that a checkpoint belongs to it */
+static struct checkpoint_run checkpoint_run;
+/* Seed of the PRNG (random unless given) and shard of its stream */
+static uint64_t seed = 0;
+static long int shard = 0;
+/* Keys are handed out to the threads by chunks of 'chunk_keys' consecutive
+ * keys, from 'next_key' (under 'schedule_lock'). The instances of key 'k'
+ * are drawn from the substream 'k' of the stream of the shard, whichever
+ * thread decodes them, so that the results do not depend on the
+ * scheduling. */
+static pthread_mutex_t schedule_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Signaled when an epoch of the sweep schedule is completed */
+static pthread_cond_t schedule_cond = PTHREAD_COND_INITIALIZER;
+static long int next_key = 0;
+static long int chunk_keys = 1;
+/* After a resume, ranges of keys [pending[2 * i], pending[2 * i + 1]) that
+ * the threads of the interrupted run had not decoded yet, handed out from
+ * 'next_pending' before 'next_key' */
+static long int *pending = NULL;
+static long int n_pending = 0;
+static long int next_pending = 0;
+/* Number of tests and of keys of the run (-1 if unbounded) */
+static long int rounds = -1;
+static long int total_keys = -1;
+/* Number of tests already done when the run was resumed */
+static long int resumed_tests = 0;
+
+static void print_parameters(parameters_t params) {
     fprintf(stderr,
-            "-DINDEX=%d "
-            "-DBLOCK_LENGTH=%d "
-            "-DBLOCK_WEIGHT=%d "
-            "-DERROR_WEIGHT=%d "
-            "-DOUROBOROS=%d "
-            "-DTTL_COEFF0=%lf "
-            "-DTTL_COEFF1=%lf "
-            "-DTTL_SATURATE=%d\n",
-            INDEX, BLOCK_LENGTH, BLOCK_WEIGHT, ERROR_WEIGHT, OUROBOROS,
-            TTL_COEFF0, TTL_COEFF1, TTL_SATURATE);
-}
-
-static void print_stats(long int *n_test, long int *n_success) {
-    if (!n_test && !n_success)
+            "--index=%ld "
+            "--block-length=%ld "
+            "--block-weight=%ld "
+            "--error-weight=%ld "
+            "--ouroboros=%d "
+            "--ttl-coeff0=%lf "
+            "--ttl-coeff1=%lf "
+            "--ttl-saturate=%d\n",
+            (long int)params->index, (long int)params->block_length,
+            (long int)params->block_weight, (long int)params->error_weight,
+            params->ouroboros, params->ttl_coeff0, params->ttl_coeff1,
+            params->ttl_saturate);
+    if (params->ttl_table) {
+        fprintf(stderr, "--ttl-table=");
+        for (index_t i = 0; i < params->ttl_table_length; ++i) {
+            fprintf(stderr, i ? ",%d" : "%d", params->ttl_table[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static void print_histogram(long int n_test, long int n_success,
+                            const long int *n_iter) {
+    fprintf(stderr, "%ld", n_test);
+    for (int it = 0; it <= max_iter; ++it) {
+        if (n_iter[it])
+            fprintf(stderr, " %d:%ld", it, n_iter[it]);
+    }
+    if (n_success != n_test)
+        fprintf(stderr, " >%d:%ld", max_iter, n_test - n_success);
+    fprintf(stderr, "\n");
+}
+
+/* The print functions take the statistics summed over all threads. */
+static void print_stats(stats_t total) {
+    print_histogram(*total->n_test, *total->n_success, total->n_iter);
+
+    if (errors_per_key) {
+        fprintf(stderr, "Keys: %ld, with failures: %ld\n", *total->n_keys,
+                *total->n_failing_keys);
+    }
+    print_estimate(total);
+    print_fit(total, 0);
+}
+
+static void print_estimate(stats_t total) {
+    if (!importance_sampling)
         return;
-    long int n_test_total = 0;
-    long int n_success_total = 0;
-    for (int i = 0; i < n_threads; ++i) {
-        n_test_total += n_test[i];
-        n_success_total += n_success[i];
+    double estimate, lower, upper;
+    overlap_estimate(&params, total->n_overlap_test,
+                     total->n_overlap_failure, &estimate, &lower, &upper);
+    fprintf(stderr, "DFR estimate: %e, 95%% interval: [%e, %e]\n", estimate,
+            lower, upper);
+}
+
+static void print_overlaps(stats_t total) {
+    if (!importance_sampling)
+        return;
+    index_t n_overlaps = overlap_max(&params) - overlap_min(&params) + 1;
+
+    for (index_t i = 0; i < n_overlaps; ++i) {
+        index_t overlap = overlap_min(&params) + i;
+        if (total->n_overlap_test[i])
+            fprintf(stderr, "Overlap %ld: %ld >%d:%ld (probability %e)\n",
+                    (long int)overlap, total->n_overlap_test[i], max_iter,
+                    total->n_overlap_failure[i],
+                    overlap_probability(&params, overlap));
     }
-    long int n_iter_total[max_iter + 1];
-    memset(n_iter_total, 0, (max_iter + 1) * sizeof(long int));
+}
 
-    for (int i = 0; i < n_threads; ++i) {
-        for (int it = 0; it <= max_iter; ++it) {
-            n_iter_total[it] += n_iter[i][it];
+/* Print the fitted log2(DFR) at the target error weight, and at all the
+ * weights of the sweep if 'verbose'. */
+static void print_fit(stats_t total, int verbose) {
+    if (!n_weights)
+        return;
+    struct sweep_fit fit;
+    if (!sweep_fit(n_weights, weights, total->n_weight_test,
+                   total->n_weight_failure, &fit)) {
+        fprintf(stderr, "Fit: not enough error weights with failures\n");
+        return;
+    }
+    if (verbose)
+        fprintf(stderr, "Fit: log2(DFR) = %f + %f * t\n",
+                fit.intercept / log(2), fit.slope / log(2));
+    for (index_t i = verbose ? 0 : n_weights; i <= n_weights; ++i) {
+        index_t t = (i < n_weights) ? weights[i] : params.error_weight;
+        double estimate, lower, upper;
+        sweep_predict(&fit, t, &estimate, &lower, &upper);
+        fprintf(stderr, "t=%ld: log2(DFR) = %f, 95%% interval: [%f, %f]\n",
+                (long int)t, estimate / log(2), lower / log(2),
+                upper / log(2));
+    }
+}
+
+static void print_sweep(stats_t total) {
+    if (!n_weights)
+        return;
+    for (index_t i = 0; i < n_weights; ++i) {
+        double lower, upper;
+        wilson_interval(total->n_weight_test[i], total->n_weight_failure[i],
+                        &lower, &upper);
+        fprintf(stderr, "Weight %ld: %ld >%d:%ld, 95%% interval: [%e, %e]\n",
+                (long int)weights[i], total->n_weight_test[i], max_iter,
+                total->n_weight_failure[i], lower, upper);
+    }
+    /* The widest weight is only used from the third epoch on. */
+    pthread_mutex_lock(&schedule_lock);
+    fprintf(stderr, "Epochs of %ld tests: %ld completed\n",
+            schedule->epoch_keys * key_size, *schedule->epochs);
+    pthread_mutex_unlock(&schedule_lock);
+    print_fit(total, 1);
+}
+
+/* Decode the current instance of 'dec' with the ttl function of every
+ * candidate, and set 'failed[c]' if candidate 'c' failed. The candidates are
+ * decoded in reverse order so that 'dec' is left in the state of the first
+ * one, whose success is returned. */
+static int decode_candidates(decoder_t dec, int *failed) {
+    for (int c = n_candidates - 1; c >= 0; --c) {
+        dec->params.ttl_coeff0 = candidates[2 * c];
+        dec->params.ttl_coeff1 = candidates[2 * c + 1];
+        update_decoder_ttl(dec);
+        if (c != n_candidates - 1)
+            restart_decoder(dec);
+        failed[c] = !qcmdpc_decode_ttl(dec, max_iter);
+    }
+    return !failed[0];
+}
+
+/* Print the DFR of each candidate, and for each pair the number of instances
+ * on which only one of them failed. Since all candidates decode the same
+ * instances, the z-score of McNemar's test tells which one is better long
+ * before their intervals are disjoint. */
+static void print_comparison(stats_t total) {
+    if (!n_candidates)
+        return;
+    for (int c = 0; c < n_candidates; ++c) {
+        double lower, upper;
+        wilson_interval(*total->n_test, total->n_candidate_failure[c], &lower,
+                        &upper);
+        fprintf(stderr,
+                "Candidate %d: --ttl-coeff0=%f --ttl-coeff1=%f %ld >%d:%ld, "
+                "95%% interval: [%e, %e]\n",
+                c, candidates[2 * c], candidates[2 * c + 1], *total->n_test,
+                max_iter, total->n_candidate_failure[c], lower, upper);
+    }
+    for (int i = 0; i < n_candidates; ++i) {
+        for (int j = i + 1; j < n_candidates; ++j) {
+            long int b_ij = total->n_discordant[i * n_candidates + j];
+            long int b_ji = total->n_discordant[j * n_candidates + i];
+            double z = (b_ij + b_ji) ? (b_ij - b_ji) / sqrt(b_ij + b_ji) : 0.;
+            fprintf(stderr,
+                    "Candidates %d-%d: only %d failed: %ld, only %d failed: "
+                    "%ld, z=%f\n",
+                    i, j, i, b_ij, j, b_ji, z);
         }
     }
+}
 
-    fprintf(stderr, "%ld", n_test_total);
-    for (int it = 0; it <= max_iter; ++it) {
-        if (n_iter_total[it])
-            fprintf(stderr, " %d:%ld", it, n_iter_total[it]);
+/* In a sweep, wait until the weight of the tests of 'key' is chosen, that is
+ * until the epochs before the previous one are completed, with
+ * 'schedule_lock' held. Since a chunk is within one epoch, this is done once
+ * per chunk. */
+static void wait_schedule(long int key) {
+    while (schedule && (total_keys == -1 || key < total_keys) &&
+           !sweep_schedule_ready(schedule, key)) {
+        pthread_cond_wait(&schedule_cond, &schedule_lock);
     }
-    if (n_success_total != n_test_total)
-        fprintf(stderr, " >%d:%ld", max_iter, n_test_total - n_success_total);
-    fprintf(stderr, "\n");
 }
 
-static void inthandler(int signo) {
-    print_stats(n_test, n_success);
+/* Move to the next key of the chunk of the thread, or to the next chunk, and
+ * start the PRNG at the substream of that key. Returns 0 when all the keys
+ * of the run are handed out. */
+static int start_key(int tid, struct key_stats *key, const uint64_t *stream,
+                     prng_t prng) {
+    if (key->index == key->chunk_end) {
+        /* The chunk is saved with the lock held, so that a checkpoint never
+         * misses a chunk handed out before 'next_key'. */
+        pthread_mutex_lock(&schedule_lock);
+        if (next_pending < n_pending) {
+            key->index = pending[2 * next_pending];
+            key->chunk_end = pending[2 * next_pending + 1];
+            ++next_pending;
+        }
+        else {
+            key->index = next_key;
+            next_key += chunk_keys;
+            key->chunk_end = next_key;
+        }
+        if (checkpoint_file)
+            stats_save(stats[tid], key->index, key->chunk_end);
+        wait_schedule(key->index);
+        pthread_mutex_unlock(&schedule_lock);
+        key->s0 = stream[0];
+        key->s1 = stream[1];
+        substream_jump(key->index, &key->s0, &key->s1);
+    }
+    if (total_keys != -1 && key->index >= total_keys)
+        return 0;
+
+    key->length = key_size;
+    if (rounds != -1 && rounds - key->index * key_size < key_size)
+        key->length = rounds - key->index * key_size;
+    prng_init(prng, key->s0, key->s1);
+    substream_jump(1, &key->s0, &key->s1);
+    return 1;
+}
 
-    if (signo != SIGHUP)
-        exit(EXIT_SUCCESS);
+/* Report the statistics of a key and move past it. */
+static void end_key(int tid, struct key_stats *key) {
+    /* The key is added to the schedule and saved at once, so that a
+     * checkpoint never has it in one and not in the other. */
+    if (schedule) {
+        pthread_mutex_lock(&schedule_lock);
+        if (sweep_schedule_add(schedule, key->index, key->n_weight_test,
+                               key->n_weight_failure))
+            pthread_cond_broadcast(&schedule_cond);
+    }
+    stats_begin(stats[tid]);
+    STATS_ADD(*stats[tid]->n_keys, 1);
+    if (key->n_success != key->n_test)
+        STATS_ADD(*stats[tid]->n_failing_keys, 1);
+    stats_end(stats[tid]);
+    if (errors_per_key) {
+#pragma omp critical
+        {
+            fprintf(stderr, "Key %ld: ", key->index);
+            print_histogram(key->n_test, key->n_success, key->n_iter);
+        }
+    }
+    key->index++;
+    key->n_test = 0;
+    key->n_success = 0;
+    memset(key->n_iter, 0, (max_iter + 1) * sizeof(long int));
+    if (checkpoint_file)
+        stats_save(stats[tid], key->index, key->chunk_end);
+    if (schedule) {
+        pthread_mutex_unlock(&schedule_lock);
+        memset(key->n_weight_test, 0, n_weights * sizeof(long int));
+        memset(key->n_weight_failure, 0, n_weights * sizeof(long int));
+    }
+}
+
+static void save_thresholds(void) {
+    if (threshold_file && !threshold_table_save(thresholds, threshold_file))
+        fprintf(stderr, "Could not save the thresholds to '%s'.\n",
+                threshold_file);
+}
+
+/* The threads cannot get a new chunk of keys while the checkpoint is
+ * written. */
+static void save_checkpoint(void) {
+    if (!checkpoint_file)
+        return;
+    pthread_mutex_lock(&schedule_lock);
+    if (!checkpoint_save(checkpoint_file, &checkpoint_run, next_key,
+                         schedule ? schedule->state : NULL,
+                         schedule ? schedule->length : 0,
+                         pending + 2 * next_pending, n_pending - next_pending,
+                         stats, n_threads))
+        fprintf(stderr, "Could not save the checkpoint to '%s'.\n",
+                checkpoint_file);
+    pthread_mutex_unlock(&schedule_lock);
+}
+
+/* Statistics with the layout of those of the threads, to sum them. */
+static stats_t stats_new_total(void) {
+    return stats_new(max_iter,
+                     importance_sampling
+                         ? overlap_max(&params) - overlap_min(&params) + 1
+                         : 0,
+                     n_candidates, n_weights);
+}
+
+/* Print the statistics of all threads, with the detailed results if 'final',
+ * and write them to stdout in the output format. */
+static void report(int final) {
+    stats_t total = stats_new_total();
+    stats_t copies[n_threads];
+    for (int i = 0; i < n_threads; ++i) {
+        copies[i] = stats_new_total();
+    }
+    stats_snapshot(total, stats, n_threads, copies);
+
+    if (final) {
+        print_overlaps(total);
+        print_sweep(total);
+        print_comparison(total);
+    }
+    print_stats(total);
+    if (output_format != OUTPUT_TEXT) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start_time.tv_sec) +
+                         (now.tv_nsec - start_time.tv_nsec) * 1e-9;
+        double throughput =
+            elapsed > 0 ? (*total->n_test - resumed_tests) / elapsed : 0.;
+        if (!output_record(stdout, output_format, &params, max_iter, mode,
+                           n_weights, weights, seed, shard, total, copies,
+                           n_threads, elapsed, throughput, final))
+            fprintf(stderr, "Could not write the record to stdout.\n");
+    }
+
+    for (int i = 0; i < n_threads; ++i) {
+        free(copies[i]);
+    }
+    free(total);
+}
+
+/* Report every TIME_BETWEEN_PRINTS seconds (unless quiet) and on SIGHUP, and
+ * the final results on SIGINT before exiting. The checkpoint is written at
+ * the same times, even if quiet. The decoding threads never print nor check
+ * the time. */
+static void *reporter(void *arg) {
+    (void)arg;
+    struct pollfd fds[2] = {{signal_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+
+    for (;;) {
+        int ready = poll(fds, 2,
+                         quiet && !checkpoint_file
+                             ? -1
+                             : TIME_BETWEEN_PRINTS * 1000);
+        if (ready < 0)
+            continue;
+        if (fds[1].revents)
+            break;
+        int signo = 0;
+        struct signalfd_siginfo info;
+        if (ready && read(signal_fd, &info, sizeof(info)) == sizeof(info))
+            signo = info.ssi_signo;
+
+        if (__atomic_load_n(&stats, __ATOMIC_ACQUIRE)) {
+            if (!quiet || signo)
+                report(signo == SIGINT);
+            save_checkpoint();
+        }
+        if (signo == SIGINT) {
+            save_thresholds();
+            exit(EXIT_SUCCESS);
+        }
+    }
+    return NULL;
+}
+
+/* Decode 'n' random instances with the ttl function of 'ttl_params' on all
+ * threads, and return the number of failures. */
+static long int run_workers(parameters_t ttl_params, long int n,
+                            void *workers) {
+    long int n_failure = 0;
+#pragma omp parallel num_threads(n_threads) reduction(+ : n_failure)
+    {
+        int tid = omp_get_thread_num();
+        struct worker *w = (struct worker *)workers + tid;
+        w->dec.params.ttl_coeff0 = ttl_params->ttl_coeff0;
+        w->dec.params.ttl_coeff1 = ttl_params->ttl_coeff1;
+        update_decoder_ttl(&w->dec);
+
+        for (long int i = tid; i < n; i += n_threads) {
+            rand_decoder_key(&w->dec, w->H, &w->prng);
+            reset_decoder(&w->dec);
+            rand_decoder_error(&w->dec, &w->prng);
+            if (!qcmdpc_decode_ttl(&w->dec, max_iter))
+                n_failure++;
+        }
+    }
+    return n_failure;
 }
 
 int main(int argc, char *argv[]) {
-    struct sigaction action;
-    action.sa_handler = inthandler;
-    sigemptyset(&action.sa_mask);
-    action.sa_flags = 0;
-    sigaction(SIGINT, &action, NULL);
-    sigaction(SIGHUP, &action, NULL);
-
-    /* Number of test rounds */
-    long int r = -1;
+    /* Blocked before any other thread is created so that they all inherit
+     * the mask. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+
     /* PRNG seeds */
     uint64_t s[2] = {0, 0};
-    int quiet = 0;
-
-    parse_arguments(argc, argv, &max_iter, &r, &n_threads, &quiet);
-    print_parameters();
+    /* Vector kernels, chosen according to the CPU unless forced */
+    kernels_t kernels = kernels_best();
+    /* Code and decoder parameters */
+    parameters_default(&params);
+    struct options opts;
+    parse_arguments(argc, argv, &opts, &params);
+    max_iter = opts.max_iter;
+    long int r = opts.rounds;
+    n_threads = opts.threads;
+    quiet = opts.quiet;
+    threshold_file = opts.threshold_file;
+    errors_per_key = opts.errors_per_key;
+    importance_sampling = opts.importance_sampling;
+    candidates = opts.compare_ttl;
+    n_candidates = opts.n_compare_ttl;
+    output_format = opts.output_format;
+    checkpoint_file = opts.checkpoint_file;
+    seed = opts.seed;
+    shard = opts.shard;
+    const int batch = opts.batch;
+    mode = (importance_sampling ? MODE_IMPORTANCE_SAMPLING : 0) |
+           (opts.sweep_step ? MODE_SWEEP : 0) |
+           (n_candidates ? MODE_COMPARE_TTL : 0) | (batch ? MODE_BATCH : 0);
+    /* The numbers of successes are those of the first candidate. */
+    if (n_candidates) {
+        params.ttl_coeff0 = candidates[0];
+        params.ttl_coeff1 = candidates[1];
+    }
 
-    seed_random(&s[0], &s[1]);
+    if (opts.kernels && !(kernels = kernels_find(opts.kernels))) {
+        fprintf(stderr, "Kernels '%s' are not supported.\n", opts.kernels);
+        print_usage(argv[0]);
+    }
+    const char *error = parameters_check(&params);
+    if (error) {
+        fprintf(stderr, "%s\n", error);
+        print_usage(argv[0]);
+    }
+    if (opts.sweep_step &&
+        opts.sweep_max > params.index * params.block_length) {
+        fprintf(stderr, "The error weights of the sweep must be at most "
+                        "INDEX * BLOCK_LENGTH\n");
+        print_usage(argv[0]);
+    }
+    print_parameters(&params);
+    /* A random seed is printed too, so that the run can be reproduced. The
+     * shards of a seed start 2^96 values apart, and the keys 2^51 values
+     * apart within a shard (the threads of the ttl optimizer 2^64 values
+     * apart). */
+    if (!opts.seeded && !seed_random(&seed, &s[1])) {
+        fprintf(stderr, "Could not read /dev/urandom.\n");
+        exit(EXIT_FAILURE);
+    }
+    seed_splitmix64(seed, &s[0], &s[1]);
+    for (long int i = 0; i < shard; ++i) {
+        long_jump(&s[0], &s[1]);
+    }
+    fprintf(stderr, "--seed=%#" PRIx64 " --shard=%ld\n", seed, shard);
+    if (batch)
+        fprintf(stderr, "Kernels: batch of %d\n", BATCH_LANES);
+    else
+        fprintf(stderr, "Kernels: %s\n", kernels->name);
+
+    /* The error weights of a sweep are all decoded with the same thresholds
+     * and the same buffers. */
+    struct parameters max_params = params;
+    if (opts.sweep_step) {
+        n_weights = (opts.sweep_max - opts.sweep_min) / opts.sweep_step + 1;
+        weights = malloc(n_weights * sizeof(index_t));
+        for (index_t i = 0; i < n_weights; ++i) {
+            weights[i] = opts.sweep_min + i * opts.sweep_step;
+        }
+        if (weights[n_weights - 1] > params.error_weight)
+            parameters_error_weight(&max_params, weights[n_weights - 1]);
+    }
 
-    time_t last_print_time = time(NULL);
+    /* Thresholds only depend on the syndrome weight and on the number of
+     * errors left, they are shared by all threads. */
+    thresholds = threshold_table_new(&max_params);
+    if (threshold_file &&
+        threshold_table_load(thresholds, threshold_file) < 0) {
+        fprintf(stderr, "Ignoring invalid thresholds in '%s'.\n",
+                threshold_file);
+        /* Do not overwrite a file that may be used for other parameters. */
+        threshold_file = NULL;
+    }
+    /* From now on, SIGINT saves the thresholds. */
+    pthread_t reporter_thread;
+    pthread_create(&reporter_thread, NULL, reporter, NULL);
+    if (opts.precompute_thresholds)
+        threshold_table_fill(thresholds, n_threads);
+
+    /* Each worker thread has its own team of decode threads. */
+    if (opts.decode_threads > 1)
+        omp_set_max_active_levels(2);
+
+    if (opts.optimize) {
+        struct worker *workers = malloc(n_threads * sizeof(struct worker));
+        for (int tid = 0; tid < n_threads; ++tid) {
+            struct worker *w = &workers[tid];
+            w->H = sparse_array_new(params.index, params.block_weight);
+            alloc_decoder(&w->dec, &params);
+            w->dec.kernels = kernels;
+            w->dec.thresholds = thresholds;
+#ifndef PACKED
+            w->dec.incremental = opts.incremental;
+#endif
+            w->dec.threads = opts.decode_threads;
+            uint64_t s0 = s[0], s1 = s[1];
+            for (int i = 0; i <= tid; ++i) {
+                jump(&s0, &s1);
+            }
+            prng_init(&w->prng, s0, s1);
+        }
+        /* The initial simplex is drawn from the stream before the jumps. */
+        struct PRNG prng;
+        prng_init(&prng, s[0], s[1]);
+        optimize_ttl(&params, r, run_workers, workers, &prng);
+        printf("--ttl-coeff0=%f --ttl-coeff1=%f\n", params.ttl_coeff0,
+               params.ttl_coeff1);
+
+        for (int tid = 0; tid < n_threads; ++tid) {
+            sparse_array_free(params.index, workers[tid].H);
+            free_decoder(&workers[tid].dec);
+        }
+        free(workers);
+        save_thresholds();
+        threshold_table_free(thresholds);
+        exit(EXIT_SUCCESS);
+    }
 
     /* Keep independent statistics for all threads. */
-    n_test = calloc(n_threads, sizeof(long int));
-    n_success = calloc(n_threads, sizeof(long int));
-    n_iter = malloc(n_threads * sizeof(long int *));
-    for (index_t i = 0; i < n_threads; ++i) {
-        n_iter[i] = calloc(max_iter + 1, sizeof(long int));
+    index_t n_overlaps = overlap_max(&params) - overlap_min(&params) + 1;
+    stats_t *thread_stats = malloc(n_threads * sizeof(stats_t));
+    for (int i = 0; i < n_threads; ++i) {
+        thread_stats[i] = stats_new_total();
     }
+    /* A new parity check matrix is drawn every 'key_size' tests (at least
+     * once per batch). */
+    key_size = errors_per_key ? errors_per_key : (batch ? BATCH_LANES : 1);
+    chunk_keys = (CHUNK_TESTS + key_size - 1) / key_size;
+    rounds = r;
+    if (r != -1)
+        total_keys = (r + key_size - 1) / key_size;
+    if (n_weights) {
+        long int epoch_chunks = SWEEP_EPOCH_TESTS / (chunk_keys * key_size);
+        if (total_keys != -1 &&
+            epoch_chunks > total_keys / chunk_keys / SWEEP_MIN_EPOCHS)
+            epoch_chunks = total_keys / chunk_keys / SWEEP_MIN_EPOCHS;
+        if (epoch_chunks < 1)
+            epoch_chunks = 1;
+        schedule = sweep_schedule_new(n_weights, epoch_chunks * chunk_keys,
+                                      total_keys);
+    }
+    checkpoint_run = (struct checkpoint_run){.params = &params,
+                                             .max_iter = max_iter,
+                                             .mode = mode,
+                                             .seed = seed,
+                                             .shard = shard,
+                                             .key_size = key_size,
+                                             .n_candidates = n_candidates,
+                                             .candidates = candidates,
+                                             .n_weights = n_weights,
+                                             .weights = weights};
+    if (schedule)
+        checkpoint_run.sweep_epoch_keys = schedule->epoch_keys;
+    if (opts.resume) {
+        /* The counters of all the threads of the interrupted run go to
+         * the first thread. */
+        int loaded = checkpoint_load(
+            checkpoint_file, &checkpoint_run, &next_key,
+            schedule ? schedule->state : NULL,
+            schedule ? schedule->length : 0, thread_stats[0], &pending,
+            &n_pending);
+        if (loaded <= 0) {
+            fprintf(stderr,
+                    loaded ? "Cannot resume from '%s' (written for other "
+                             "parameters, mode or seed).\n"
+                           : "Cannot resume from '%s' (no such file).\n",
+                    checkpoint_file);
+            exit(EXIT_FAILURE);
+        }
+        stats_save(thread_stats[0], 0, 0);
+        resumed_tests = *thread_stats[0]->n_test;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    __atomic_store_n(&stats, thread_stats, __ATOMIC_RELEASE);
 
 #pragma omp parallel num_threads(n_threads)
     {
         int tid = omp_get_thread_num();
-
-        int thread_quiet = tid ? 1 : quiet;
+        stats_t st = stats[tid];
 
         /* Parity check matrix */
-        sparse_t *H = sparse_array_new(INDEX, BLOCK_WEIGHT);
+        sparse_t *H = sparse_array_new(params.index, params.block_weight);
         /* Error pattern */
-        sparse_t e_block = sparse_new(ERROR_WEIGHT);
+        sparse_t e_block = sparse_new(max_params.error_weight);
+        /* Positions already drawn, for the patterns not drawn by the
+         * decoder */
+        packed_t bitmap =
+            sample_bitmap_new(params.index * params.block_length);
+
+        /* Near-codeword with which the overlap of the error is controlled */
+        sparse_t support = NULL;
+        if (importance_sampling)
+            support = sparse_new(OVERLAP_WEIGHT(&params));
 
         /* Error pattern on the syndrome (for Ouroboros) */
-#if !OUROBOROS
         sparse_t e2_block = NULL;
-#else
-        sparse_t e2_block = sparse_new(ERROR_WEIGHT / 2);
-#endif
+        if (params.ouroboros)
+            e2_block = sparse_new(max_params.syndrome_stop);
 
         struct decoder dec;
-        alloc_decoder(&dec);
-
-        prng_t prng = malloc(sizeof(struct PRNG));
-        prng->s0 = s[0];
-        prng->s1 = s[1];
-        prng->random_lim = random_lim;
-        prng->random_uint64_t = random_uint64_t;
-
-        for (int i = 0; i < tid; ++i) {
-            jump(&prng->s0, &prng->s1);
-        }
-
-        long int thread_total_tests = (tid + r) / n_threads;
-        while (r == -1 || n_test[tid] < thread_total_tests) {
-            sparse_array_rand(INDEX, BLOCK_LENGTH, BLOCK_WEIGHT, prng, H);
-
-            sparse_rand(INDEX * BLOCK_LENGTH, ERROR_WEIGHT, prng, e_block);
-#if OUROBOROS
-            sparse_rand(BLOCK_LENGTH, SYNDROME_STOP, prng, e2_block);
+        alloc_decoder(&dec, &params);
+        dec.kernels = kernels;
+        dec.thresholds = thresholds;
+#ifndef PACKED
+        dec.incremental = opts.incremental;
 #endif
-
-            reset_decoder(&dec);
-            init_decoder_error(&dec, H, e_block, e2_block);
-
-            if (qcmdpc_decode_ttl(&dec, max_iter)) {
-                n_success[tid]++;
-                n_iter[tid][dec.iter]++;
+        dec.threads = opts.decode_threads;
+
+        struct batch_decoder bdec;
+        sparse_t e_blocks[BATCH_LANES];
+        sparse_t e2_blocks[BATCH_LANES];
+        if (batch) {
+            alloc_batch_decoder(&bdec, &params);
+            bdec.thresholds = thresholds;
+            for (int b = 0; b < BATCH_LANES; ++b) {
+                e_blocks[b] = sparse_new(params.error_weight);
+                e2_blocks[b] = params.ouroboros
+                                   ? sparse_new(params.syndrome_stop)
+                                   : NULL;
             }
+        }
 
-            n_test[tid]++;
+        prng_t prng = malloc(sizeof(struct PRNG));
+        struct key_stats key = {0};
+        key.n_iter = calloc(max_iter + 1, sizeof(long int));
+        key.n_weight_test = calloc(n_weights, sizeof(long int));
+        key.n_weight_failure = calloc(n_weights, sizeof(long int));
+
+        while (start_key(tid, &key, s, prng)) {
+            if (batch) {
+                sparse_array_rand(params.index, params.block_length,
+                                  params.block_weight, prng, bitmap, H);
+                while (key.n_test < key.length) {
+                    for (int b = 0; b < BATCH_LANES; ++b) {
+                        sparse_rand_unsorted(
+                            params.index * params.block_length,
+                            params.error_weight, prng, bitmap, e_blocks[b]);
+                        if (params.ouroboros)
+                            sparse_rand_unsorted(params.block_length,
+                                                 params.syndrome_stop, prng,
+                                                 bitmap, e2_blocks[b]);
+                    }
+
+                    init_batch_decoder_error(&bdec, H, e_blocks, e2_blocks);
+                    batch_decode_ttl(&bdec, max_iter);
+
+                    /* Only count the lanes needed to complete the key. */
+                    stats_begin(st);
+                    for (int b = 0; b < BATCH_LANES && key.n_test < key.length;
+                         ++b) {
+                        if (bdec.syndrome_weight[b] == params.syndrome_stop) {
+                            STATS_ADD(*st->n_success, 1);
+                            STATS_ADD(st->n_iter[bdec.iter[b]], 1);
+                            key.n_success++;
+                            key.n_iter[bdec.iter[b]]++;
+                        }
+                        STATS_ADD(*st->n_test, 1);
+                        key.n_test++;
+                    }
+                    stats_end(st);
+                }
+                end_key(tid, &key);
+                continue;
+            }
 
-            time_t current_time;
-            if (!thread_quiet && (current_time = time(NULL)) >
-                                     last_print_time + TIME_BETWEEN_PRINTS) {
-                print_stats(n_test, n_success);
-                last_print_time = current_time;
+            rand_decoder_key(&dec, H, prng);
+            if (importance_sampling)
+                overlap_support(&params, H, support);
+            while (key.n_test < key.length) {
+                /* Index of the test in the run */
+                long int test = key.index * key_size + key.n_test;
+                /* With importance sampling, all overlaps are tried in
+                 * turn. */
+                index_t overlap = test % n_overlaps;
+                /* In a sweep, every other test goes to the error weight with
+                 * the widest interval (as of the epoch before the previous
+                 * one), the others to all weights in turn. */
+                index_t weight = 0;
+                if (n_weights) {
+                    weight = (test % 2)
+                                 ? sweep_schedule_widest(schedule, key.index)
+                                 : -1;
+                    if (weight == -1)
+                        weight = (test / 2) % n_weights;
+                    parameters_error_weight(&dec.params, weights[weight]);
+                }
+                reset_decoder(&dec);
+                if (importance_sampling) {
+                    overlap_rand(&params, support,
+                                 overlap_min(&params) + overlap, prng, bitmap,
+                                 e_block);
+                    if (params.ouroboros)
+                        sparse_rand_unsorted(params.block_length,
+                                             dec.params.syndrome_stop, prng,
+                                             bitmap, e2_block);
+                    init_decoder_error(&dec, e_block, e2_block);
+                }
+                else {
+                    rand_decoder_error(&dec, prng);
+                }
+
+                int failed[n_candidates > 0 ? n_candidates : 1];
+                int success = n_candidates
+                                  ? decode_candidates(&dec, failed)
+                                  : qcmdpc_decode_ttl(&dec, max_iter);
+
+                stats_begin(st);
+                if (success) {
+                    STATS_ADD(*st->n_success, 1);
+                    STATS_ADD(st->n_iter[dec.iter], 1);
+                    key.n_success++;
+                    key.n_iter[dec.iter]++;
+                }
+                else {
+                    if (importance_sampling)
+                        STATS_ADD(st->n_overlap_failure[overlap], 1);
+                    if (n_weights) {
+                        STATS_ADD(st->n_weight_failure[weight], 1);
+                        key.n_weight_failure[weight]++;
+                    }
+                }
+                if (importance_sampling)
+                    STATS_ADD(st->n_overlap_test[overlap], 1);
+                if (n_weights) {
+                    STATS_ADD(st->n_weight_test[weight], 1);
+                    key.n_weight_test[weight]++;
+                }
+                for (int i = 0; i < n_candidates; ++i) {
+                    STATS_ADD(st->n_candidate_failure[i], failed[i]);
+                    for (int j = 0; j < n_candidates; ++j) {
+                        STATS_ADD(st->n_discordant[i * n_candidates + j],
+                                  failed[i] && !failed[j]);
+                    }
+                }
+                STATS_ADD(*st->n_test, 1);
+                stats_end(st);
+                key.n_test++;
             }
+            end_key(tid, &key);
         }
+        if (batch) {
+            for (int b = 0; b < BATCH_LANES; ++b) {
+                sparse_free(e_blocks[b]);
+                if (e2_blocks[b])
+                    sparse_free(e2_blocks[b]);
+            }
+            free_batch_decoder(&bdec);
+        }
+        free(key.n_iter);
+        free(key.n_weight_test);
+        free(key.n_weight_failure);
         free(prng);
-        sparse_array_free(INDEX, H);
+        free(bitmap);
+        sparse_array_free(params.index, H);
         sparse_free(e_block);
+        if (support)
+            sparse_free(support);
         if (e2_block) {
             sparse_free(e2_block);
         }
         free_decoder(&dec);
     }
 
-    print_stats(n_test, n_success);
-    free(n_test);
-    free(n_success);
-    for (index_t i = 0; i < n_threads; ++i) {
-        free(n_iter[i]);
+    /* The reporter thread is stopped before the final results are printed
+     * so that they are not interleaved with a periodic report. */
+    uint64_t stop = 1;
+    if (write(stop_fd, &stop, sizeof(stop)) == sizeof(stop))
+        pthread_join(reporter_thread, NULL);
+    report(1);
+    save_checkpoint();
+    for (int i = 0; i < n_threads; ++i) {
+        free(stats[i]);
+    }
+    free(stats);
+    if (n_candidates)
+        free(candidates);
+    if (n_weights) {
+        free(weights);
+        free(schedule);
     }
-    free(n_iter);
+    free(pending);
+    save_thresholds();
+    threshold_table_free(thresholds);
+    free((uint8_t *)params.ttl_table);
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,101 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <stdlib.h>
+
+#include "sampling.h"
+#include "sparse_cyclic.h"
+
+packed_t sample_bitmap_new(index_t length) {
+    return calloc((length + WORD_BITS - 1) / WORD_BITS, sizeof(word_t));
+}
+
+/* Set 'weight' distinct random bits among the first 'length' of 'bitmap',
+ * and write their positions in 'h' if not NULL. */
+static void bitmap_rand(index_t length, index_t weight, prng_t prng,
+                        packed_t bitmap, sparse_t h) {
+    for (index_t i = 0; i < weight; ++i) {
+        index_t pos;
+        do {
+            pos = prng_lim(prng, length - 1);
+        } while (packed_get(bitmap, pos));
+        packed_flip(bitmap, pos);
+        if (h)
+            h[i] = pos;
+    }
+}
+
+/* The bitmap is scanned (and cleared) once, which costs 'length / 64' words
+ * but sorts the positions without any comparison. */
+sparse_t sparse_rand(index_t length, index_t weight, prng_t prng,
+                     packed_t bitmap, sparse_t h) {
+    bitmap_rand(length, weight, prng, bitmap, NULL);
+
+    index_t n = 0;
+    for (index_t i = 0; n < weight; ++i) {
+        for (word_t w = bitmap[i]; w; w &= w - 1) {
+            h[n++] = i * WORD_BITS + __builtin_ctzll(w);
+        }
+        bitmap[i] = 0;
+    }
+    return h;
+}
+
+sparse_t sparse_rand_unsorted(index_t length, index_t weight, prng_t prng,
+                              packed_t bitmap, sparse_t h) {
+    bitmap_rand(length, weight, prng, bitmap, h);
+
+    for (index_t i = 0; i < weight; ++i) {
+        bitmap[h[i] / WORD_BITS] = 0;
+    }
+    return h;
+}
+
+sparse_t *sparse_array_rand(index_t index, index_t length, index_t weight,
+                            prng_t prng, packed_t bitmap, sparse_t *H) {
+    for (index_t i = 0; i < index; ++i) {
+        sparse_rand(length, weight, prng, bitmap, H[i]);
+    }
+
+    return H;
+}
+
+/* Position 'j' of the column is position '-j mod length' of the row, so that
+ * the row is the column reversed, except for a 0 that stays first. */
+void circulant_rand(index_t length, index_t weight, prng_t prng,
+                    packed_t bitmap, sparse_t column, sparse_t row) {
+    bitmap_rand(length, weight, prng, bitmap, NULL);
+
+    const index_t last = (bitmap[0] & 1) ? weight : weight - 1;
+    index_t n = 0;
+    for (index_t i = 0; n < weight; ++i) {
+        for (word_t w = bitmap[i]; w; w &= w - 1) {
+            const index_t pos = i * WORD_BITS + __builtin_ctzll(w);
+            column[n] = pos;
+            if (pos)
+                row[last - n] = length - pos;
+            else
+                row[0] = 0;
+            ++n;
+        }
+        bitmap[i] = 0;
+    }
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef SAMPLING_H
+#define SAMPLING_H
+#include "types.h"
+#include "xoroshiro128plus.h"
+
+/* Fixed weight vectors are drawn by rejection: a position whose bit is
+ * already set in a bitmap is drawn again. The bitmaps (of at least the length
+ * of the vectors) are all zero between two calls. */
+packed_t sample_bitmap_new(index_t length);
+
+/* 'weight' distinct positions among 'length', in increasing order or in the
+ * order they were drawn. */
+sparse_t sparse_rand(index_t length, index_t weight, prng_t prng,
+                     packed_t bitmap, sparse_t h);
+sparse_t sparse_rand_unsorted(index_t length, index_t weight, prng_t prng,
+                              packed_t bitmap, sparse_t h);
+sparse_t *sparse_array_rand(index_t index, index_t length, index_t weight,
+                            prng_t prng, packed_t bitmap, sparse_t *H);
+
+/* Random circulant block given by its first column (sorted) and its first
+ * row (sorted), both written while scanning the bitmap. */
+void circulant_rand(index_t length, index_t weight, prng_t prng,
+                    packed_t bitmap, sparse_t column, sparse_t row);
+#endif
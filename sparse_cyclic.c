@@ -23,11 +23,10 @@
 #include <immintrin.h>
 #endif
 #include <stdlib.h>
+#include <string.h>
 
 #include "sparse_cyclic.h"
 
-static void insert_sorted(index_t value, index_t max_i, index_t *array);
-
 sparse_t sparse_new(index_t weight) {
     sparse_t h = (index_t *)malloc(weight * sizeof(index_t));
 
@@ -53,100 +52,317 @@ void sparse_array_free(index_t index, sparse_t *h) {
     free(h);
 }
 
-/* Insert in place. */
-static void insert_sorted(index_t value, index_t max_i, index_t *array) {
-    index_t i;
-    for (i = 0; i < max_i && array[i] <= value; i++, value++)
-        ;
-    for (index_t j = max_i; j > i; j--)
-        array[j] = array[j - 1];
-    array[i] = value;
-}
-
-/* Pick a random (sparse) binary block h of weight 'weight' in a previously
- * allocated block. */
-sparse_t sparse_rand(index_t length, index_t weight, prng_t prng, sparse_t h) {
-    /* Get an ordered list of positions for which the bit should be set to 1. */
-    for (index_t i = 0; i < weight; i++) {
-        index_t rand = prng->random_lim(--length, &prng->s0, &prng->s1);
-        insert_sorted(rand, i, h);
+/* The dense kernels below share the same conventions: 'y' has been
+ * duplicated (y[block_length + i] == y[i]) so that its cyclic shift by x[j]
+ * can be read as a contiguous range, and each of them is given the actual
+ * block length (vector versions round it up to a multiple of their block). */
+
+/* Kept out of line so that the compiler vectorizes each row on its own
+ * instead of interleaving rows into a scalar loop. */
+static __attribute__((noinline)) void add_row(index_t length,
+                                              const bit_t *restrict y,
+                                              bit_t *restrict z) {
+    for (index_t i = 0; i < length; ++i) {
+        z[i] += y[i];
     }
-    return h;
 }
 
-sparse_t *sparse_array_rand(index_t index, index_t length, index_t weight,
-                            prng_t prng, sparse_t *H) {
-    for (index_t i = 0; i < index; ++i) {
-        sparse_rand(length, weight, prng, H[i]);
+static __attribute__((noinline)) void xor_row(index_t length,
+                                              const bit_t *restrict y,
+                                              bit_t *restrict z) {
+    for (index_t i = 0; i < length; ++i) {
+        z[i] ^= y[i];
     }
-
-    return H;
 }
 
-struct mult_t {
-    dense_t y;
-    dense_t z;
-    index_t len;
-};
+/* z[i] = sum(y[i + x[j]]) */
+void multiply(index_t block_length, index_t block_weight,
+              const sparse_t restrict x, const dense_t restrict y,
+              dense_t restrict z) {
+    memset(z, 0, block_length);
+    for (index_t j = 0; j < block_weight; ++j) {
+        add_row(block_length, y + x[j], z);
+    }
+}
 
+/* z[i] ^= sum(y[i + x[j]]) mod 2 */
 void multiply_mod2(index_t block_length, index_t block_weight,
                    const sparse_t restrict x, const dense_t restrict y,
                    dense_t restrict z) {
-    /* Avoid doing a modulo operation by precomputing the wrapping around. */
-    struct mult_t queue[2 * block_weight];
-    struct mult_t *restrict queue1 = queue;
-    struct mult_t *restrict queue2 = queue + block_weight;
-    for (index_t k = 0; k < block_weight; ++k) {
-        queue1[k].z = z + x[k];
-        queue1[k].y = y;
-        queue1[k].len = block_length - x[k];
-        queue2[k].z = z;
-        queue2[k].y = y + block_length - x[k];
-        queue2[k].len = x[k];
+    for (index_t j = 0; j < block_weight; ++j) {
+        xor_row(block_length, y + x[j], z);
     }
-    for (index_t k = 0; k < 2 * block_weight; ++k) {
-        dense_t restrict y = queue[k].y;
-        dense_t restrict z = queue[k].z;
-        index_t len = queue[k].len;
+}
 
-        for (index_t i = 0; i < len; ++i) {
-            z[i] ^= y[i];
+/* Write in 'positions' (in increasing order) the positions whose counter is
+ * at least 'threshold', and the corresponding counters in 'values'. Returns
+ * the number of such positions. */
+index_t above_threshold(index_t block_length, const dense_t restrict counters,
+                        unsigned threshold, index_t *restrict positions,
+                        counter_t *restrict values) {
+    index_t n = 0;
+    for (index_t i = 0; i < block_length; ++i) {
+        if (counters[i] >= threshold) {
+            positions[n] = i;
+            values[n] = counters[i];
+            ++n;
         }
     }
+    return n;
 }
 
-void multiply(index_t block_length, index_t block_weight,
-              const sparse_t restrict x, const dense_t restrict y,
-              dense_t restrict z) {
-    /* Avoid doing a modulo operation by precomputing the wrapping around. */
-    struct mult_t queue[2 * block_weight];
-    struct mult_t *restrict queue1 = queue;
-    struct mult_t *restrict queue2 = queue + block_weight;
-    for (index_t k = 0; k < block_weight; ++k) {
-        queue1[k].z = z + x[k];
-        queue1[k].y = y;
-        queue1[k].len = block_length - x[k];
-        queue2[k].z = z;
-        queue2[k].y = y + block_length - x[k];
-        queue2[k].len = x[k];
+/* multiply followed by above_threshold. The vector versions compare the
+ * counters while they are still in registers or in the L1 cache instead of
+ * reading them again in a second pass. */
+index_t multiply_threshold(index_t block_length, index_t block_weight,
+                           const sparse_t restrict x, const dense_t restrict y,
+                           dense_t restrict z, unsigned threshold,
+                           index_t *restrict positions,
+                           counter_t *restrict values) {
+    multiply(block_length, block_weight, x, y, z);
+    return above_threshold(block_length, z, threshold, positions, values);
+}
+
+/* Same as above_threshold and multiply_threshold with 16-bit counters, for
+ * block weights larger than MAX_NARROW_WEIGHT. */
+index_t above_threshold_wide(index_t block_length,
+                             const wide_t restrict counters,
+                             unsigned threshold, index_t *restrict positions,
+                             counter_t *restrict values) {
+    index_t n = 0;
+    for (index_t i = 0; i < block_length; ++i) {
+        if (counters[i] >= threshold) {
+            positions[n] = i;
+            values[n] = counters[i];
+            ++n;
+        }
+    }
+    return n;
+}
+
+index_t multiply_threshold_wide(index_t block_length, index_t block_weight,
+                                const sparse_t restrict x,
+                                const dense_t restrict y, wide_t restrict z,
+                                unsigned threshold,
+                                index_t *restrict positions,
+                                counter_t *restrict values) {
+    memset(z, 0, block_length * sizeof(counter_t));
+    for (index_t j = 0; j < block_weight; ++j) {
+        const bit_t *restrict row = y + x[j];
+        for (index_t i = 0; i < block_length; ++i) {
+            z[i] += row[i];
+        }
     }
-    for (index_t k = 0; k < 2 * block_weight; ++k) {
-        dense_t restrict y = queue[k].y;
-        dense_t restrict z = queue[k].z;
-        index_t len = queue[k].len;
+    return above_threshold_wide(block_length, z, threshold, positions, values);
+}
+
+/* Copy the first 'block_length' bits of a packed vector right after
+ * themselves so that any cyclic rotation can be read as a contiguous range of
+ * bits. */
+void packed_duplicate(index_t block_length, packed_t y) {
+    index_t q = block_length / WORD_BITS;
+    int b = block_length % WORD_BITS;
+
+    if (!b) {
+        memcpy(y + q, y, q * sizeof(word_t));
+        return;
+    }
+    y[q] &= ((word_t)1 << b) - 1;
+    /* Go backward so that source words are read before being overwritten. */
+    y[2 * q + 1] = y[q] >> (WORD_BITS - b);
+    for (index_t w = q; w > 0; --w) {
+        y[q + w] = (y[w] << b) | (y[w - 1] >> (WORD_BITS - b));
+    }
+    y[q] |= y[0] << b;
+}
+
+/* Number of words kept in registers by the packed kernels. */
+#define PACKED_BLOCK 16
+
+/* Bodies of the packed kernels, instantiated below for each instruction set
+ * (target-specific versions only differ by the code the compiler generates). */
+
+/* z ^= sum(rot(y, x[j])) where 'y' has been duplicated with
+ * 'packed_duplicate'. Each rotation is read as a bit-shifted range of words. */
+ALWAYS_INLINE void multiply_mod2_packed_body(index_t block_length,
+                                             index_t block_weight,
+                                             const sparse_t restrict x,
+                                             const packed_t restrict y,
+                                             packed_t restrict z) {
+    index_t n_words = (block_length + WORD_BITS - 1) / WORD_BITS;
+    index_t i;
+
+    for (i = 0; i < n_words; i += PACKED_BLOCK) {
+        word_t acc[PACKED_BLOCK];
+        for (int k = 0; k < PACKED_BLOCK; ++k) {
+            acc[k] = z[i + k];
+        }
+        for (index_t j = 0; j < block_weight; ++j) {
+            const word_t *restrict src = y + i + x[j] / WORD_BITS;
+            int b = x[j] % WORD_BITS;
+            for (int k = 0; k < PACKED_BLOCK; ++k) {
+                /* Shift in two steps to stay defined when b == 0. */
+                acc[k] ^= (src[k] >> b) |
+                          ((src[k + 1] << 1) << (WORD_BITS - 1 - b));
+            }
+        }
+        for (int k = 0; k < PACKED_BLOCK; ++k) {
+            z[i + k] = acc[k];
+        }
+    }
+    /* Clear what has been accumulated past the end of the block. */
+    if (block_length % WORD_BITS) {
+        z[n_words - 1] &= ((word_t)1 << (block_length % WORD_BITS)) - 1;
+    }
+    memset(z + n_words, 0, (i - n_words) * sizeof(word_t));
+}
+
+void multiply_mod2_packed(index_t block_length, index_t block_weight,
+                          const sparse_t restrict x, const packed_t restrict y,
+                          packed_t restrict z) {
+    multiply_mod2_packed_body(block_length, block_weight, x, y, z);
+}
+
+/* Number of words processed at once by the bit-sliced kernel. */
+#define SLICE_WORDS 4
+/* Number of bit planes for the counters (enough for block_weight <= 65535),
+ * only the first 8 are used when block_weight <= MAX_NARROW_WEIGHT. */
+#define SLICE_PLANES 16
+
+/* SLICE_WORDS words, one vector register when available. */
+typedef word_t slice_t __attribute__((vector_size(SLICE_WORDS * 8)));
+
+/* Carry-save adder: (h, l) = a + b + c. */
+#define CSA(h, l, a, b, c)                                                     \
+    do {                                                                       \
+        slice_t a_ = (a), b_ = (b), c_ = (c);                                  \
+        slice_t u_ = a_ ^ b_;                                                  \
+        (h) = (a_ & b_) | (u_ & c_);                                           \
+        (l) = u_ ^ c_;                                                         \
+    } while (0)
 
-        for (index_t i = 0; i < len; ++i) {
-            z[i] += y[i];
+/* Read SLICE_WORDS words of 'y' starting at bit 'offset'. */
+#define READ_SHIFTED(y, offset)                                                \
+    ({                                                                         \
+        const word_t *restrict src_ = (y) + (offset) / WORD_BITS;              \
+        int b_ = (offset) % WORD_BITS;                                         \
+        slice_t lo_, hi_;                                                      \
+        memcpy(&lo_, src_, sizeof(slice_t));                                   \
+        memcpy(&hi_, src_ + 1, sizeof(slice_t));                               \
+        /* Shift in two steps to stay defined when b_ == 0. */                 \
+        (lo_ >> b_) | ((hi_ << 1) << (WORD_BITS - 1 - b_));                    \
+    })
+
+/* Add 'in' (of weight 2^first) to the vertical counters stored in the first
+ * 'n_planes' planes of 'planes'. */
+#define ADD_SLICED(planes, n_planes, first, in)                                \
+    do {                                                                       \
+        slice_t c_ = (in);                                                     \
+        for (int p_ = (first); p_ < (n_planes); ++p_) {                        \
+            slice_t t_ = (planes)[p_] & c_;                                    \
+            (planes)[p_] ^= c_;                                                \
+            c_ = t_;                                                           \
+        }                                                                      \
+    } while (0)
+
+/* Compute the same counters as 'multiply' (with 'x' being the columns and
+ * 'y' the packed syndrome duplicated with 'packed_duplicate') as bit slices,
+ * then compare them to 'threshold' without ever storing them.
+ * Positions whose counter is at least 'threshold' are written in increasing
+ * order in 'positions' with their counter in 'counters'. Returns the number
+ * of such positions. */
+ALWAYS_INLINE index_t multiply_threshold_packed_body(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const packed_t restrict y, unsigned threshold, index_t *restrict positions,
+    counter_t *restrict counters, int n_planes) {
+    index_t n_words = (block_length + WORD_BITS - 1) / WORD_BITS;
+    index_t n = 0;
+
+    for (index_t i = 0; i < n_words; i += SLICE_WORDS) {
+        const packed_t y_i = y + i;
+        slice_t planes[SLICE_PLANES] = {0};
+        slice_t twos_a, twos_b, fours_a, fours_b, eights;
+
+        /* Harley-Seal: compress the columns 8 by 8 into the first three
+         * planes, then propagate the carry of weight 8. */
+        index_t j;
+        for (j = 0; j + 8 <= block_weight; j += 8) {
+            CSA(twos_a, planes[0], planes[0], READ_SHIFTED(y_i, x[j]),
+                READ_SHIFTED(y_i, x[j + 1]));
+            CSA(twos_b, planes[0], planes[0], READ_SHIFTED(y_i, x[j + 2]),
+                READ_SHIFTED(y_i, x[j + 3]));
+            CSA(fours_a, planes[1], planes[1], twos_a, twos_b);
+            CSA(twos_a, planes[0], planes[0], READ_SHIFTED(y_i, x[j + 4]),
+                READ_SHIFTED(y_i, x[j + 5]));
+            CSA(twos_b, planes[0], planes[0], READ_SHIFTED(y_i, x[j + 6]),
+                READ_SHIFTED(y_i, x[j + 7]));
+            CSA(fours_b, planes[1], planes[1], twos_a, twos_b);
+            CSA(eights, planes[2], planes[2], fours_a, fours_b);
+            ADD_SLICED(planes, n_planes, 3, eights);
+        }
+        for (; j < block_weight; ++j) {
+            ADD_SLICED(planes, n_planes, 0, READ_SHIFTED(y_i, x[j]));
+        }
+
+        /* Bit-sliced comparison with the threshold, from the most significant
+         * plane down. */
+        slice_t ge = {0};
+        slice_t eq = ~ge;
+        for (int p = n_planes - 1; p >= 0; --p) {
+            if ((threshold >> p) & 1) {
+                eq &= planes[p];
+            }
+            else {
+                ge |= eq & planes[p];
+                eq &= ~planes[p];
+            }
+        }
+        ge |= eq;
+
+        for (int k = 0; k < SLICE_WORDS; ++k) {
+            word_t mask = ge[k];
+            index_t base = (i + k) * WORD_BITS;
+            if (base + WORD_BITS > block_length) {
+                mask = (base >= block_length)
+                           ? 0
+                           : mask & (((word_t)1 << (block_length - base)) - 1);
+            }
+            while (mask) {
+                int b = __builtin_ctzll(mask);
+                counter_t counter = 0;
+                for (int p = 0; p < n_planes; ++p) {
+                    counter |= ((planes[p][k] >> b) & 1) << p;
+                }
+                positions[n] = base + b;
+                counters[n] = counter;
+                ++n;
+                mask &= mask - 1;
+            }
         }
     }
+    return n;
+}
+
+index_t multiply_threshold_packed(index_t block_length, index_t block_weight,
+                                  const sparse_t restrict x,
+                                  const packed_t restrict y, unsigned threshold,
+                                  index_t *restrict positions,
+                                  counter_t *restrict counters) {
+    if (block_weight > MAX_NARROW_WEIGHT)
+        return multiply_threshold_packed_body(block_length, block_weight, x, y,
+                                              threshold, positions, counters,
+                                              SLICE_PLANES);
+    return multiply_threshold_packed_body(block_length, block_weight, x, y,
+                                          threshold, positions, counters, 8);
 }
 
 #ifdef AVX
-void multiply_mod2_avx2(index_t block_length, index_t block_weight,
-                        const sparse_t restrict x, const dense_t restrict y,
-                        dense_t restrict z) {
+__attribute__((target("avx2"))) void
+multiply_mod2_avx2(index_t block_length, index_t block_weight,
+                   const sparse_t restrict x, const dense_t restrict y,
+                   dense_t restrict z) {
     /* I could not manage to make GCC unroll that loop automatically. */
-    for (index_t i = 0; i < block_length / 32; i += 16) {
+    for (index_t i = 0; i < (block_length + 31) / 32; i += 16) {
         __m256i vec_x0;
         __m256i vec_x1;
         __m256i vec_x2;
@@ -362,11 +578,12 @@ void multiply_mod2_avx2(index_t block_length, index_t block_weight,
     }
 }
 
-void multiply_avx2(index_t block_length, index_t block_weight,
-                   const sparse_t restrict x, const dense_t restrict y,
-                   dense_t restrict z) {
+__attribute__((target("avx2"))) void
+multiply_avx2(index_t block_length, index_t block_weight,
+              const sparse_t restrict x, const dense_t restrict y,
+              dense_t restrict z) {
     /* I could not manage to make GCC unroll that loop automatically. */
-    for (index_t i = 0; i < block_length / 32; i += 16) {
+    for (index_t i = 0; i < (block_length + 31) / 32; i += 16) {
         __m256i vec_x0;
         __m256i vec_x1;
         __m256i vec_x2;
@@ -549,4 +766,590 @@ void multiply_avx2(index_t block_length, index_t block_weight,
                      :);
     }
 }
+
+__attribute__((target("avx2"))) index_t
+above_threshold_avx2(index_t block_length, const dense_t restrict counters,
+                     unsigned threshold, index_t *restrict positions,
+                     counter_t *restrict values) {
+    const __m256i t = _mm256_set1_epi8(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += 32) {
+        __m256i c = _mm256_load_si256((const __m256i *)(counters + i));
+        /* Unsigned c >= t iff max(c, t) == c */
+        uint32_t mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(c, t), c));
+        if (block_length - i < 32) {
+            mask &= (1U << (block_length - i)) - 1;
+        }
+        while (mask) {
+            int b = __builtin_ctz(mask);
+            positions[n] = i + b;
+            values[n] = counters[i + b];
+            ++n;
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
+
+/* Number of counters computed at once by multiply_avx2 (16 ymm registers). */
+#define YMM_TILE (16 * 32)
+
+__attribute__((target("avx2"))) index_t
+multiply_threshold_avx2(index_t block_length, index_t block_weight,
+                        const sparse_t restrict x, const dense_t restrict y,
+                        dense_t restrict z, unsigned threshold,
+                        index_t *restrict positions, counter_t *restrict values) {
+    index_t n = 0;
+
+    /* One tile at a time, scanned right after it was written. */
+    for (index_t i = 0; i < block_length; i += YMM_TILE) {
+        multiply_avx2(YMM_TILE, block_weight, x, y + i, z + i);
+        index_t length =
+            (block_length - i < YMM_TILE) ? block_length - i : YMM_TILE;
+        index_t m = above_threshold_avx2(length, z + i, threshold,
+                                         positions + n, values + n);
+        for (index_t c = n; c < n + m; ++c) {
+            positions[c] += i;
+        }
+        n += m;
+    }
+    return n;
+}
+
+/* Number of ymm accumulators of the wide kernels, leaving registers for the
+ * zero extension of the syndrome bytes. */
+#define YMM_WIDE_BLOCK 8
+
+/* Positions of a 32-bit movemask of 16-bit comparisons (two bits per
+ * counter). */
+#define WIDE_MASK 0x55555555U
+
+__attribute__((target("avx2"))) index_t
+above_threshold_wide_avx2(index_t block_length, const wide_t restrict counters,
+                          unsigned threshold, index_t *restrict positions,
+                          counter_t *restrict values) {
+    const __m256i t = _mm256_set1_epi16(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += 16) {
+        __m256i c = _mm256_load_si256((const __m256i *)(counters + i));
+        uint32_t mask = _mm256_movemask_epi8(
+                            _mm256_cmpeq_epi16(_mm256_max_epu16(c, t), c)) &
+                        WIDE_MASK;
+        if (block_length - i < 16) {
+            mask &= (1U << (2 * (block_length - i))) - 1;
+        }
+        while (mask) {
+            int b = __builtin_ctz(mask) / 2;
+            positions[n] = i + b;
+            values[n] = counters[i + b];
+            ++n;
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) index_t multiply_threshold_wide_avx2(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const dense_t restrict y, wide_t restrict z, unsigned threshold,
+    index_t *restrict positions, counter_t *restrict values) {
+    const __m256i t = _mm256_set1_epi16(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += YMM_WIDE_BLOCK * 16) {
+        __m256i acc[YMM_WIDE_BLOCK];
+#pragma GCC unroll 8
+        for (int k = 0; k < YMM_WIDE_BLOCK; ++k) {
+            acc[k] = _mm256_setzero_si256();
+        }
+        for (index_t j = 0; j < block_weight; ++j) {
+            const bit_t *restrict src = y + x[j] + i;
+#pragma GCC unroll 8
+            for (int k = 0; k < YMM_WIDE_BLOCK; ++k) {
+                acc[k] = _mm256_add_epi16(
+                    acc[k], _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                                (const __m128i *)(src + 16 * k))));
+            }
+        }
+        uint32_t masks[YMM_WIDE_BLOCK];
+        uint32_t any = 0;
+#pragma GCC unroll 8
+        for (int k = 0; k < YMM_WIDE_BLOCK; ++k) {
+            _mm256_store_si256((__m256i *)(z + i + 16 * k), acc[k]);
+            masks[k] = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                           _mm256_max_epu16(acc[k], t), acc[k])) &
+                       WIDE_MASK;
+            any |= masks[k];
+        }
+        if (!any)
+            continue;
+        for (int k = 0; k < YMM_WIDE_BLOCK; ++k) {
+            index_t base = i + 16 * k;
+            uint32_t mask = masks[k];
+            if (base + 16 > block_length) {
+                mask = (base >= block_length)
+                           ? 0
+                           : mask & ((1U << (2 * (block_length - base))) - 1);
+            }
+            while (mask) {
+                int b = __builtin_ctz(mask) / 2;
+                positions[n] = base + b;
+                values[n] = z[base + b];
+                ++n;
+                mask &= mask - 1;
+            }
+        }
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) void
+multiply_mod2_packed_avx2(index_t block_length, index_t block_weight,
+                          const sparse_t restrict x, const packed_t restrict y,
+                          packed_t restrict z) {
+    multiply_mod2_packed_body(block_length, block_weight, x, y, z);
+}
+
+__attribute__((target("avx2"))) index_t multiply_threshold_packed_avx2(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const packed_t restrict y, unsigned threshold, index_t *restrict positions,
+    counter_t *restrict counters) {
+    if (block_weight > MAX_NARROW_WEIGHT)
+        return multiply_threshold_packed_body(block_length, block_weight, x, y,
+                                              threshold, positions, counters,
+                                              SLICE_PLANES);
+    return multiply_threshold_packed_body(block_length, block_weight, x, y,
+                                          threshold, positions, counters, 8);
+}
+
+/* AVX-512 versions: 32 zmm registers of 512 bits, with masked comparisons and
+ * VPTERNLOG to merge three-input boolean functions into one instruction. */
+#define AVX512 __attribute__((target("avx512f,avx512bw")))
+
+/* Number of zmm accumulators in the dense kernels (16 * 64 bytes is the
+ * granularity of AVX_PADDING). */
+#define ZMM_BLOCK 16
+
+AVX512 void multiply_avx512(index_t block_length, index_t block_weight,
+                            const sparse_t restrict x, const dense_t restrict y,
+                            dense_t restrict z) {
+    for (index_t i = 0; i < block_length; i += ZMM_BLOCK * 64) {
+        __m512i acc[ZMM_BLOCK];
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            acc[k] = _mm512_setzero_si512();
+        }
+        for (index_t j = 0; j < block_weight; ++j) {
+            const bit_t *restrict src = y + x[j] + i;
+#pragma GCC unroll 16
+            for (int k = 0; k < ZMM_BLOCK; ++k) {
+                acc[k] =
+                    _mm512_add_epi8(acc[k], _mm512_loadu_si512(src + 64 * k));
+            }
+        }
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            _mm512_store_si512(z + i + 64 * k, acc[k]);
+        }
+    }
+}
+
+AVX512 void multiply_mod2_avx512(index_t block_length, index_t block_weight,
+                                 const sparse_t restrict x,
+                                 const dense_t restrict y, dense_t restrict z) {
+    for (index_t i = 0; i < block_length; i += ZMM_BLOCK * 64) {
+        __m512i acc[ZMM_BLOCK];
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            acc[k] = _mm512_load_si512(z + i + 64 * k);
+        }
+        index_t j;
+        /* Two columns at a time: acc ^= a ^ b is a single VPTERNLOG. */
+        for (j = 0; j + 2 <= block_weight; j += 2) {
+            const bit_t *restrict src0 = y + x[j] + i;
+            const bit_t *restrict src1 = y + x[j + 1] + i;
+#pragma GCC unroll 16
+            for (int k = 0; k < ZMM_BLOCK; ++k) {
+                acc[k] = _mm512_ternarylogic_epi64(
+                    acc[k], _mm512_loadu_si512(src0 + 64 * k),
+                    _mm512_loadu_si512(src1 + 64 * k), 0x96);
+            }
+        }
+        for (; j < block_weight; ++j) {
+            const bit_t *restrict src = y + x[j] + i;
+#pragma GCC unroll 16
+            for (int k = 0; k < ZMM_BLOCK; ++k) {
+                acc[k] =
+                    _mm512_xor_si512(acc[k], _mm512_loadu_si512(src + 64 * k));
+            }
+        }
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            _mm512_store_si512(z + i + 64 * k, acc[k]);
+        }
+    }
+}
+
+AVX512 index_t above_threshold_avx512(index_t block_length,
+                                      const dense_t restrict counters,
+                                      unsigned threshold,
+                                      index_t *restrict positions,
+                                      counter_t *restrict values) {
+    const __m512i t = _mm512_set1_epi8(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += 64) {
+        __m512i c = _mm512_load_si512(counters + i);
+        uint64_t mask = _mm512_cmpge_epu8_mask(c, t);
+        if (block_length - i < 64) {
+            mask &= ((uint64_t)1 << (block_length - i)) - 1;
+        }
+        while (mask) {
+            int b = __builtin_ctzll(mask);
+            positions[n] = i + b;
+            values[n] = counters[i + b];
+            ++n;
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
+
+AVX512 index_t multiply_threshold_avx512(index_t block_length,
+                                         index_t block_weight,
+                                         const sparse_t restrict x,
+                                         const dense_t restrict y,
+                                         dense_t restrict z, unsigned threshold,
+                                         index_t *restrict positions,
+                                         counter_t *restrict values) {
+    const __m512i t = _mm512_set1_epi8(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += ZMM_BLOCK * 64) {
+        __m512i acc[ZMM_BLOCK];
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            acc[k] = _mm512_setzero_si512();
+        }
+        for (index_t j = 0; j < block_weight; ++j) {
+            const bit_t *restrict src = y + x[j] + i;
+#pragma GCC unroll 16
+            for (int k = 0; k < ZMM_BLOCK; ++k) {
+                acc[k] =
+                    _mm512_add_epi8(acc[k], _mm512_loadu_si512(src + 64 * k));
+            }
+        }
+        uint64_t masks[ZMM_BLOCK];
+        uint64_t any = 0;
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            _mm512_store_si512(z + i + 64 * k, acc[k]);
+            masks[k] = _mm512_cmpge_epu8_mask(acc[k], t);
+            any |= masks[k];
+        }
+        /* Most tiles have no candidate. */
+        if (!any)
+            continue;
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            index_t base = i + 64 * k;
+            uint64_t mask = masks[k];
+            if (base + 64 > block_length) {
+                mask = (base >= block_length)
+                           ? 0
+                           : mask & (((uint64_t)1 << (block_length - base)) - 1);
+            }
+            while (mask) {
+                int b = __builtin_ctzll(mask);
+                positions[n] = base + b;
+                values[n] = z[base + b];
+                ++n;
+                mask &= mask - 1;
+            }
+        }
+    }
+    return n;
+}
+
+AVX512 index_t above_threshold_wide_avx512(index_t block_length,
+                                           const wide_t restrict counters,
+                                           unsigned threshold,
+                                           index_t *restrict positions,
+                                           counter_t *restrict values) {
+    const __m512i t = _mm512_set1_epi16(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += 32) {
+        __m512i c = _mm512_load_si512(counters + i);
+        uint32_t mask = _mm512_cmpge_epu16_mask(c, t);
+        if (block_length - i < 32) {
+            mask &= ((uint32_t)1 << (block_length - i)) - 1;
+        }
+        while (mask) {
+            int b = __builtin_ctz(mask);
+            positions[n] = i + b;
+            values[n] = counters[i + b];
+            ++n;
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
+
+/* 16-bit counters: each zmm accumulates 32 zero-extended syndrome bytes. */
+AVX512 index_t multiply_threshold_wide_avx512(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const dense_t restrict y, wide_t restrict z, unsigned threshold,
+    index_t *restrict positions, counter_t *restrict values) {
+    const __m512i t = _mm512_set1_epi16(threshold);
+    index_t n = 0;
+
+    for (index_t i = 0; i < block_length; i += ZMM_BLOCK * 32) {
+        __m512i acc[ZMM_BLOCK];
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            acc[k] = _mm512_setzero_si512();
+        }
+        for (index_t j = 0; j < block_weight; ++j) {
+            const bit_t *restrict src = y + x[j] + i;
+#pragma GCC unroll 16
+            for (int k = 0; k < ZMM_BLOCK; ++k) {
+                acc[k] = _mm512_add_epi16(
+                    acc[k], _mm512_cvtepu8_epi16(_mm256_loadu_si256(
+                                (const __m256i *)(src + 32 * k))));
+            }
+        }
+        uint32_t masks[ZMM_BLOCK];
+        uint32_t any = 0;
+#pragma GCC unroll 16
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            _mm512_store_si512(z + i + 32 * k, acc[k]);
+            masks[k] = _mm512_cmpge_epu16_mask(acc[k], t);
+            any |= masks[k];
+        }
+        if (!any)
+            continue;
+        for (int k = 0; k < ZMM_BLOCK; ++k) {
+            index_t base = i + 32 * k;
+            uint32_t mask = masks[k];
+            if (base + 32 > block_length) {
+                mask = (base >= block_length)
+                           ? 0
+                           : mask & (((uint32_t)1 << (block_length - base)) - 1);
+            }
+            while (mask) {
+                int b = __builtin_ctz(mask);
+                positions[n] = base + b;
+                values[n] = z[base + b];
+                ++n;
+                mask &= mask - 1;
+            }
+        }
+    }
+    return n;
+}
+
+AVX512 void multiply_mod2_packed_avx512(index_t block_length,
+                                        index_t block_weight,
+                                        const sparse_t restrict x,
+                                        const packed_t restrict y,
+                                        packed_t restrict z) {
+    multiply_mod2_packed_body(block_length, block_weight, x, y, z);
+}
+
+/* Read 8 words of 'y' starting at bit 'offset'. */
+AVX512 static inline __m512i read_shifted_avx512(const packed_t restrict y,
+                                                 index_t offset) {
+    const word_t *restrict src = y + offset / WORD_BITS;
+    __m128i b = _mm_cvtsi32_si128(offset % WORD_BITS);
+    __m128i c = _mm_cvtsi32_si128(WORD_BITS - offset % WORD_BITS);
+    /* Shifting by 64 gives 0, no special case for aligned offsets. */
+    return _mm512_or_si512(_mm512_srl_epi64(_mm512_loadu_si512(src), b),
+                           _mm512_sll_epi64(_mm512_loadu_si512(src + 1), c));
+}
+
+/* Carry-save adder with VPTERNLOG: h = majority(a, b, c), l = a ^ b ^ c. */
+#define CSA512(h, l, a, b, c)                                                  \
+    do {                                                                       \
+        __m512i a_ = (a), b_ = (b), c_ = (c);                                  \
+        (h) = _mm512_ternarylogic_epi64(a_, b_, c_, 0xe8);                     \
+        (l) = _mm512_ternarylogic_epi64(a_, b_, c_, 0x96);                     \
+    } while (0)
+
+AVX512 ALWAYS_INLINE index_t multiply_threshold_packed_avx512_body(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const packed_t restrict y, unsigned threshold, index_t *restrict positions,
+    counter_t *restrict counters, int n_planes) {
+    index_t n_words = (block_length + WORD_BITS - 1) / WORD_BITS;
+    index_t n = 0;
+
+    for (index_t i = 0; i < n_words; i += 8) {
+        const packed_t y_i = y + i;
+        __m512i planes[SLICE_PLANES];
+        __m512i twos_a, twos_b, fours_a, fours_b, eights;
+        for (int p = 0; p < n_planes; ++p) {
+            planes[p] = _mm512_setzero_si512();
+        }
+
+        index_t j;
+        for (j = 0; j + 8 <= block_weight; j += 8) {
+            CSA512(twos_a, planes[0], planes[0], read_shifted_avx512(y_i, x[j]),
+                   read_shifted_avx512(y_i, x[j + 1]));
+            CSA512(twos_b, planes[0], planes[0],
+                   read_shifted_avx512(y_i, x[j + 2]),
+                   read_shifted_avx512(y_i, x[j + 3]));
+            CSA512(fours_a, planes[1], planes[1], twos_a, twos_b);
+            CSA512(twos_a, planes[0], planes[0],
+                   read_shifted_avx512(y_i, x[j + 4]),
+                   read_shifted_avx512(y_i, x[j + 5]));
+            CSA512(twos_b, planes[0], planes[0],
+                   read_shifted_avx512(y_i, x[j + 6]),
+                   read_shifted_avx512(y_i, x[j + 7]));
+            CSA512(fours_b, planes[1], planes[1], twos_a, twos_b);
+            CSA512(eights, planes[2], planes[2], fours_a, fours_b);
+            for (int p = 3; p < n_planes; ++p) {
+                __m512i t = _mm512_and_si512(planes[p], eights);
+                planes[p] = _mm512_xor_si512(planes[p], eights);
+                eights = t;
+            }
+        }
+        for (; j < block_weight; ++j) {
+            __m512i in = read_shifted_avx512(y_i, x[j]);
+            for (int p = 0; p < n_planes; ++p) {
+                __m512i t = _mm512_and_si512(planes[p], in);
+                planes[p] = _mm512_xor_si512(planes[p], in);
+                in = t;
+            }
+        }
+
+        __m512i ge = _mm512_setzero_si512();
+        __m512i eq = _mm512_set1_epi64(-1);
+        for (int p = n_planes - 1; p >= 0; --p) {
+            if ((threshold >> p) & 1) {
+                eq = _mm512_and_si512(eq, planes[p]);
+            }
+            else {
+                /* ge |= eq & planes[p] */
+                ge = _mm512_ternarylogic_epi64(ge, eq, planes[p], 0xf8);
+                eq = _mm512_andnot_si512(planes[p], eq);
+            }
+        }
+        ge = _mm512_or_si512(ge, eq);
+
+        /* Skip the extraction when no counter reached the threshold. */
+        if (!_mm512_test_epi64_mask(ge, ge)) {
+            continue;
+        }
+        word_t ge_words[8], plane_words[SLICE_PLANES][8];
+        _mm512_storeu_si512(ge_words, ge);
+        for (int p = 0; p < n_planes; ++p) {
+            _mm512_storeu_si512(plane_words[p], planes[p]);
+        }
+        for (int k = 0; k < 8; ++k) {
+            word_t mask = ge_words[k];
+            index_t base = (i + k) * WORD_BITS;
+            if (base + WORD_BITS > block_length) {
+                mask = (base >= block_length)
+                           ? 0
+                           : mask & (((word_t)1 << (block_length - base)) - 1);
+            }
+            while (mask) {
+                int b = __builtin_ctzll(mask);
+                counter_t counter = 0;
+                for (int p = 0; p < n_planes; ++p) {
+                    counter |= ((plane_words[p][k] >> b) & 1) << p;
+                }
+                positions[n] = base + b;
+                counters[n] = counter;
+                ++n;
+                mask &= mask - 1;
+            }
+        }
+    }
+    return n;
+}
+
+AVX512 index_t multiply_threshold_packed_avx512(
+    index_t block_length, index_t block_weight, const sparse_t restrict x,
+    const packed_t restrict y, unsigned threshold, index_t *restrict positions,
+    counter_t *restrict counters) {
+    if (block_weight > MAX_NARROW_WEIGHT)
+        return multiply_threshold_packed_avx512_body(
+            block_length, block_weight, x, y, threshold, positions, counters,
+            SLICE_PLANES);
+    return multiply_threshold_packed_avx512_body(
+        block_length, block_weight, x, y, threshold, positions, counters, 8);
+}
+#endif
+
+const struct kernels kernels_generic = {
+    "generic",
+    multiply,
+    multiply_mod2,
+    above_threshold,
+    multiply_threshold,
+    above_threshold_wide,
+    multiply_threshold_wide,
+    multiply_mod2_packed,
+    multiply_threshold_packed,
+};
+
+#ifdef AVX
+const struct kernels kernels_avx2 = {
+    "avx2",
+    multiply_avx2,
+    multiply_mod2_avx2,
+    above_threshold_avx2,
+    multiply_threshold_avx2,
+    above_threshold_wide_avx2,
+    multiply_threshold_wide_avx2,
+    multiply_mod2_packed_avx2,
+    multiply_threshold_packed_avx2,
+};
+
+const struct kernels kernels_avx512 = {
+    "avx512",
+    multiply_avx512,
+    multiply_mod2_avx512,
+    above_threshold_avx512,
+    multiply_threshold_avx512,
+    above_threshold_wide_avx512,
+    multiply_threshold_wide_avx512,
+    multiply_mod2_packed_avx512,
+    multiply_threshold_packed_avx512,
+};
+#endif
+
+/* Best kernels supported by the CPU we are running on. */
+kernels_t kernels_best(void) {
+#ifdef AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return &kernels_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return &kernels_avx2;
 #endif
+    return &kernels_generic;
+}
+
+/* Kernels called 'name', NULL if they do not exist or are not supported. */
+kernels_t kernels_find(const char *name) {
+    kernels_t all[] = {
+#ifdef AVX
+        &kernels_avx512,
+        &kernels_avx2,
+#endif
+        &kernels_generic,
+    };
+    kernels_t best = kernels_best();
+    int supported = 0;
+
+    for (size_t i = 0; i < sizeof(all) / sizeof(*all); ++i) {
+        supported |= (all[i] == best);
+        if (supported && !strcmp(all[i]->name, name))
+            return all[i];
+    }
+    return NULL;
+}
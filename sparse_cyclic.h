@@ -22,16 +22,12 @@
 #ifndef SPARSE_CYCLIC_H
 #define SPARSE_CYCLIC_H
 #include "types.h"
-#include "xoroshiro128plus.h"
 
 sparse_t sparse_new(index_t weight);
 void sparse_free(sparse_t h);
-sparse_t sparse_rand(index_t length, index_t weight, prng_t prng, sparse_t h);
 
 sparse_t *sparse_array_new(index_t index, index_t weight);
 void sparse_array_free(index_t index, sparse_t *h);
-sparse_t *sparse_array_rand(index_t index, index_t length, index_t weight,
-                            prng_t prng, sparse_t *H);
 
 void multiply(index_t block_length, index_t block_weight,
               const sparse_t restrict x, const dense_t restrict y,
@@ -39,12 +35,86 @@ void multiply(index_t block_length, index_t block_weight,
 void multiply_mod2(index_t block_length, index_t block_weight,
                    const sparse_t restrict x, const dense_t restrict y,
                    dense_t restrict z);
-#ifdef AVX
-void multiply_avx2(index_t block_length, index_t block_weight,
-                   const sparse_t restrict x, const dense_t restrict y,
-                   dense_t restrict z);
-void multiply_mod2_avx2(index_t block_length, index_t block_weight,
-                        const sparse_t restrict x, const dense_t restrict y,
-                        dense_t restrict z);
-#endif
+index_t above_threshold(index_t block_length, const dense_t restrict counters,
+                        unsigned threshold, index_t *restrict positions,
+                        counter_t *restrict values);
+index_t multiply_threshold(index_t block_length, index_t block_weight,
+                           const sparse_t restrict x, const dense_t restrict y,
+                           dense_t restrict z, unsigned threshold,
+                           index_t *restrict positions,
+                           counter_t *restrict values);
+index_t above_threshold_wide(index_t block_length,
+                             const wide_t restrict counters,
+                             unsigned threshold, index_t *restrict positions,
+                             counter_t *restrict values);
+index_t multiply_threshold_wide(index_t block_length, index_t block_weight,
+                                const sparse_t restrict x,
+                                const dense_t restrict y, wide_t restrict z,
+                                unsigned threshold,
+                                index_t *restrict positions,
+                                counter_t *restrict values);
+void packed_duplicate(index_t block_length, packed_t y);
+void multiply_mod2_packed(index_t block_length, index_t block_weight,
+                          const sparse_t restrict x, const packed_t restrict y,
+                          packed_t restrict z);
+index_t multiply_threshold_packed(index_t block_length, index_t block_weight,
+                                  const sparse_t restrict x,
+                                  const packed_t restrict y, unsigned threshold,
+                                  index_t *restrict positions,
+                                  counter_t *restrict counters);
+
+/* Kernels used by the decoder, chosen at runtime depending on the CPU. */
+struct kernels {
+    const char *name;
+    void (*multiply)(index_t block_length, index_t block_weight,
+                     const sparse_t restrict x, const dense_t restrict y,
+                     dense_t restrict z);
+    void (*multiply_mod2)(index_t block_length, index_t block_weight,
+                          const sparse_t restrict x, const dense_t restrict y,
+                          dense_t restrict z);
+    index_t (*above_threshold)(index_t block_length,
+                               const dense_t restrict counters,
+                               unsigned threshold, index_t *restrict positions,
+                               counter_t *restrict values);
+    index_t (*multiply_threshold)(index_t block_length, index_t block_weight,
+                                  const sparse_t restrict x,
+                                  const dense_t restrict y, dense_t restrict z,
+                                  unsigned threshold,
+                                  index_t *restrict positions,
+                                  counter_t *restrict values);
+    index_t (*above_threshold_wide)(index_t block_length,
+                                    const wide_t restrict counters,
+                                    unsigned threshold,
+                                    index_t *restrict positions,
+                                    counter_t *restrict values);
+    index_t (*multiply_threshold_wide)(index_t block_length,
+                                       index_t block_weight,
+                                       const sparse_t restrict x,
+                                       const dense_t restrict y,
+                                       wide_t restrict z, unsigned threshold,
+                                       index_t *restrict positions,
+                                       counter_t *restrict values);
+    void (*multiply_mod2_packed)(index_t block_length, index_t block_weight,
+                                 const sparse_t restrict x,
+                                 const packed_t restrict y,
+                                 packed_t restrict z);
+    index_t (*multiply_threshold_packed)(index_t block_length,
+                                         index_t block_weight,
+                                         const sparse_t restrict x,
+                                         const packed_t restrict y,
+                                         unsigned threshold,
+                                         index_t *restrict positions,
+                                         counter_t *restrict counters);
+};
+
+kernels_t kernels_best(void);
+kernels_t kernels_find(const char *name);
+
+static inline bit_t packed_get(const word_t *v, index_t i) {
+    return (v[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+}
+
+static inline void packed_flip(word_t *v, index_t i) {
+    v[i / WORD_BITS] ^= (word_t)1 << (i % WORD_BITS);
+}
 #endif
@@ -0,0 +1,112 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+/* Cache line size */
+#define STATS_ALIGN 64
+
+stats_t stats_new(int max_iter, index_t n_overlaps, int n_candidates,
+                  index_t n_weights) {
+    const long int length = 4 + (max_iter + 1) + 2 * n_overlaps +
+                            n_candidates + n_candidates * n_candidates +
+                            2 * n_weights;
+    size_t size = sizeof(struct stats) +
+                  (2 * length + 2) * sizeof(long int);
+    size = (size + STATS_ALIGN - 1) / STATS_ALIGN * STATS_ALIGN;
+    stats_t s = aligned_alloc(STATS_ALIGN, size);
+    memset(s, 0, size);
+
+    s->length = length;
+    long int *c = s->counters;
+    s->n_test = c++;
+    s->n_success = c++;
+    s->n_keys = c++;
+    s->n_failing_keys = c++;
+    s->n_iter = c;
+    c += max_iter + 1;
+    s->n_overlap_test = c;
+    c += n_overlaps;
+    s->n_overlap_failure = c;
+    c += n_overlaps;
+    s->n_candidate_failure = c;
+    c += n_candidates;
+    s->n_discordant = c;
+    c += n_candidates * n_candidates;
+    s->n_weight_test = c;
+    c += n_weights;
+    s->n_weight_failure = c;
+    c += n_weights;
+    s->saved = c;
+    return s;
+}
+
+/* Sum in 'total' the counters of all threads, each of them read as it was
+ * between two updates (and kept in 'copies[t]' if 'copies' is not NULL). */
+void stats_snapshot(stats_t total, stats_t const *threads, int n_threads,
+                    stats_t *copies) {
+    const long int length = total->length;
+    long int buffer[length];
+
+    memset(total->counters, 0, length * sizeof(long int));
+    for (int t = 0; t < n_threads; ++t) {
+        const stats_t s = threads[t];
+        long int *copy = copies ? copies[t]->counters : buffer;
+        unsigned long seq;
+        do {
+            seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+            for (long int i = 0; i < length; ++i) {
+                copy[i] = __atomic_load_n(&s->counters[i], __ATOMIC_RELAXED);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while ((seq & 1) || seq != __atomic_load_n(&s->seq, __ATOMIC_RELAXED));
+        for (long int i = 0; i < length; ++i) {
+            total->counters[i] += copy[i];
+        }
+    }
+}
+
+/* Called by the thread itself between two keys, when its counters hold
+ * all the keys it completed before 'key' (no key is half counted). */
+void stats_save(stats_t s, long int key, long int chunk_end) {
+    stats_begin(s);
+    for (long int i = 0; i < s->length; ++i) {
+        __atomic_store_n(&s->saved[i], s->counters[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->saved[s->length], key, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->saved[s->length + 1], chunk_end, __ATOMIC_RELAXED);
+    stats_end(s);
+}
+
+void stats_read_saved(stats_t s, long int *saved) {
+    const long int length = STATS_SAVED_LENGTH(s);
+    unsigned long seq;
+    do {
+        seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        for (long int i = 0; i < length; ++i) {
+            saved[i] = __atomic_load_n(&s->saved[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&s->seq, __ATOMIC_RELAXED));
+}
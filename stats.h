@@ -0,0 +1,85 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef STATS_H
+#define STATS_H
+#include "types.h"
+
+/* Statistics of the decodings of a thread. The counters are on cache lines
+ * of their own, written only by their thread between stats_begin and
+ * stats_end, and read at any time by other threads with stats_snapshot
+ * (the sequence number is odd during an update, a reader that sees it change
+ * reads again). */
+struct stats {
+    unsigned long seq;
+    long int length;
+    long int *n_test;
+    long int *n_success;
+    /* Number of keys, and of keys with at least one failure */
+    long int *n_keys;
+    long int *n_failing_keys;
+    /* Number of successes for each number of iterations */
+    long int *n_iter;
+    /* With importance sampling, number of tests and failures for each
+     * overlap (from overlap_min) */
+    long int *n_overlap_test;
+    long int *n_overlap_failure;
+    /* With --compare-ttl, number of failures of each candidate, and number of
+     * instances on which only candidate i failed and not candidate j (at
+     * index i * n_candidates + j) */
+    long int *n_candidate_failure;
+    long int *n_discordant;
+    /* With a sweep, number of tests and failures for each error weight */
+    long int *n_weight_test;
+    long int *n_weight_failure;
+    /* Copy of the counters followed by the key the thread is at and the end
+     * of its chunk of keys, taken by stats_save at the last key boundary,
+     * from which the thread can resume */
+    long int *saved;
+    /* All the counters above point into this array */
+    long int counters[];
+};
+typedef struct stats *stats_t;
+
+stats_t stats_new(int max_iter, index_t n_overlaps, int n_candidates,
+                  index_t n_weights);
+void stats_snapshot(stats_t total, stats_t const *threads, int n_threads,
+                    stats_t *copies);
+void stats_save(stats_t s, long int key, long int chunk_end);
+void stats_read_saved(stats_t s, long int *saved);
+
+/* Number of values of 'saved' */
+#define STATS_SAVED_LENGTH(s) ((s)->length + 2)
+
+static inline void stats_begin(stats_t s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void stats_end(stats_t s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Add to a counter of the calling thread, between stats_begin and stats_end
+ * (the thread may read its own counters directly). */
+#define STATS_ADD(counter, value)                                              \
+    __atomic_store_n(&(counter), (counter) + (value), __ATOMIC_RELAXED)
+#endif
@@ -0,0 +1,164 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "importance.h"
+#include "sweep.h"
+
+/* Quantile of the normal distribution for the 95% confidence intervals */
+#define Z_95 1.959963984540054
+
+/* Index of the weight whose 95% interval is the widest on a log scale, among
+ * the weights with at least one failure (the interval of the others is not
+ * bounded below). Returns -1 if no weight failed yet. */
+index_t sweep_widest(index_t n_weights, const long int *n_test,
+                     const long int *n_failure) {
+    index_t widest = -1;
+    double widest_width = 0.;
+    for (index_t i = 0; i < n_weights; ++i) {
+        if (!n_failure[i])
+            continue;
+        double lower, upper;
+        wilson_interval(n_test[i], n_failure[i], &lower, &upper);
+        double width = log(upper) - log(lower);
+        if (widest == -1 || width > widest_width) {
+            widest = i;
+            widest_width = width;
+        }
+    }
+    return widest;
+}
+
+sweep_schedule_t sweep_schedule_new(index_t n_weights, long int epoch_keys,
+                                    long int total_keys) {
+    const long int length = 3 + 2 * n_weights + 2 + 4 * n_weights;
+    sweep_schedule_t s =
+        calloc(1, sizeof(struct sweep_schedule) + length * sizeof(long int));
+
+    s->n_weights = n_weights;
+    s->epoch_keys = epoch_keys;
+    s->total_keys = total_keys;
+    s->length = length;
+    long int *c = s->state;
+    s->epochs = c++;
+    s->widest = c;
+    c += 2;
+    s->n_test = c;
+    c += n_weights;
+    s->n_failure = c;
+    c += n_weights;
+    s->epoch_keys_done = c;
+    c += 2;
+    s->epoch_test = c;
+    c += 2 * n_weights;
+    s->epoch_failure = c;
+    s->widest[0] = s->widest[1] = -1;
+    return s;
+}
+
+/* Add the numbers of tests and failures of each weight of a completed key.
+ * When this completes the oldest epoch not completed yet (and maybe the next
+ * one), its results are summed with those of the previous epochs and the
+ * weight of the epoch two epochs later is chosen from them. Returns 1 if an
+ * epoch was completed, 0 otherwise. */
+int sweep_schedule_add(sweep_schedule_t s, long int key,
+                       const long int *n_test, const long int *n_failure) {
+    const index_t n_weights = s->n_weights;
+    const long int slot = (key / s->epoch_keys) % 2;
+    for (index_t i = 0; i < n_weights; ++i) {
+        s->epoch_test[slot * n_weights + i] += n_test[i];
+        s->epoch_failure[slot * n_weights + i] += n_failure[i];
+    }
+    s->epoch_keys_done[slot]++;
+
+    int completed = 0;
+    for (;;) {
+        const long int epoch = *s->epochs;
+        const long int first = epoch * s->epoch_keys;
+        long int keys = s->epoch_keys;
+        if (s->total_keys != -1 && s->total_keys - first < keys)
+            keys = s->total_keys - first;
+        long int *test = s->epoch_test + (epoch % 2) * n_weights;
+        long int *failure = s->epoch_failure + (epoch % 2) * n_weights;
+        if (keys <= 0 || s->epoch_keys_done[epoch % 2] != keys)
+            return completed;
+
+        for (index_t i = 0; i < n_weights; ++i) {
+            s->n_test[i] += test[i];
+            s->n_failure[i] += failure[i];
+        }
+        memset(test, 0, n_weights * sizeof(long int));
+        memset(failure, 0, n_weights * sizeof(long int));
+        s->epoch_keys_done[epoch % 2] = 0;
+        s->widest[epoch % 2] = sweep_widest(n_weights, s->n_test, s->n_failure);
+        ++*s->epochs;
+        completed = 1;
+    }
+}
+
+/* Weighted least squares fit of the logarithm of the failure rates. The
+ * variance of log(p) is about (1 - p) / (n p), the inverse is used as the
+ * weight of each point. Weights without failures (or that always fail) are
+ * ignored. Returns 0 if there are not enough points for a fit. */
+int sweep_fit(index_t n_weights, const index_t *weights,
+              const long int *n_test, const long int *n_failure,
+              struct sweep_fit *fit) {
+    double sw = 0., swx = 0., swxx = 0., swy = 0., swxy = 0.;
+    index_t n_points = 0;
+    for (index_t i = 0; i < n_weights; ++i) {
+        if (!n_failure[i] || n_failure[i] == n_test[i])
+            continue;
+        double p = (double)n_failure[i] / n_test[i];
+        double w = n_test[i] * p / (1 - p);
+        double x = weights[i];
+        double y = log(p);
+        sw += w;
+        swx += w * x;
+        swxx += w * x * x;
+        swy += w * y;
+        swxy += w * x * y;
+        ++n_points;
+    }
+    double det = sw * swxx - swx * swx;
+    if (n_points < 2 || det <= 0.)
+        return 0;
+    fit->slope = (sw * swxy - swx * swy) / det;
+    fit->intercept = (swxx * swy - swx * swxy) / det;
+    fit->var_intercept = swxx / det;
+    fit->var_slope = sw / det;
+    fit->covariance = -swx / det;
+    return 1;
+}
+
+/* Fitted log(DFR) at error weight 't' and its 95% interval. */
+void sweep_predict(const struct sweep_fit *fit, index_t t, double *estimate,
+                   double *lower, double *upper) {
+    double variance = fit->var_intercept + 2 * t * fit->covariance +
+                      (double)t * t * fit->var_slope;
+    double radius = Z_95 * sqrt(variance);
+
+    *estimate = fit->intercept + fit->slope * t;
+    *lower = *estimate - radius;
+    *upper = *estimate + radius;
+}
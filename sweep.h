@@ -0,0 +1,86 @@
+/*
+   Copyright (c) 2019 Valentin Vasseur
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE
+*/
+#ifndef SWEEP_H
+#define SWEEP_H
+#include "types.h"
+
+/* Fit of log(DFR) = intercept + slope * t, with the covariance matrix of the
+ * coefficients */
+struct sweep_fit {
+    double intercept;
+    double slope;
+    double var_intercept;
+    double var_slope;
+    double covariance;
+};
+
+/* Choice of the weight with the widest interval, which only depends on the
+ * keys completed before. Keys are grouped in epochs of 'epoch_keys' keys,
+ * and the keys of epoch 'e' use the weight chosen from the results of the
+ * epochs 0 to e - 2. All the values are in 'state', which is written to the
+ * checkpoints. */
+struct sweep_schedule {
+    index_t n_weights;
+    long int epoch_keys;
+    /* Number of keys of the run (-1 if unbounded) */
+    long int total_keys;
+    long int length;
+    /* Number of epochs completed, whose results are summed in 'n_test' and
+     * 'n_failure' */
+    long int *epochs;
+    /* Weight of epoch 'e' at index e % 2 (-1 if none failed yet) */
+    long int *widest;
+    long int *n_test;
+    long int *n_failure;
+    /* Number of keys completed, tests and failures of each weight, of the
+     * epochs not completed yet (epochs and epochs + 1) at index e % 2 */
+    long int *epoch_keys_done;
+    long int *epoch_test;
+    long int *epoch_failure;
+    long int state[];
+};
+typedef struct sweep_schedule *sweep_schedule_t;
+
+index_t sweep_widest(index_t n_weights, const long int *n_test,
+                     const long int *n_failure);
+sweep_schedule_t sweep_schedule_new(index_t n_weights, long int epoch_keys,
+                                    long int total_keys);
+int sweep_schedule_add(sweep_schedule_t s, long int key,
+                       const long int *n_test, const long int *n_failure);
+
+/* Whether the weight of 'key' is known, that is whether all the epochs
+ * before the previous one are completed */
+static inline int sweep_schedule_ready(sweep_schedule_t s, long int key) {
+    return *s->epochs >= key / s->epoch_keys - 1;
+}
+
+/* Weight of the widest interval for the tests of 'key' (-1 if none) */
+static inline index_t sweep_schedule_widest(sweep_schedule_t s,
+                                            long int key) {
+    return s->widest[(key / s->epoch_keys) % 2];
+}
+int sweep_fit(index_t n_weights, const index_t *weights,
+              const long int *n_test, const long int *n_failure,
+              struct sweep_fit *fit);
+void sweep_predict(const struct sweep_fit *fit, index_t t, double *estimate,
+                   double *lower, double *upper);
+#endif
@@ -20,17 +20,21 @@
    IN THE SOFTWARE
 */
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "param.h"
 #include "threshold.h"
 
 static double lnbino(unsigned n, unsigned t);
 static double xlny(double x, double y);
 static double lnbinomialpmf(unsigned n, unsigned k, double p, double q);
-static double Euh_log(unsigned t, unsigned i);
-static double iks(unsigned t);
-static double counters_C0(unsigned S, unsigned t, double x);
-static double counters_C1(unsigned S, unsigned t, double x);
+static double Euh_log(parameters_t params, unsigned t, unsigned i);
+static double iks(parameters_t params, unsigned t);
+static double counters_C0(parameters_t params, unsigned S, unsigned t,
+                          double x);
+static double counters_C1(parameters_t params, unsigned S, unsigned t,
+                          double x);
 
 static double lnbino(unsigned n, unsigned t) {
     if ((t == 0) || (n == t))
@@ -51,14 +55,14 @@ static double lnbinomialpmf(unsigned n, unsigned k, double p, double q) {
     return lnbino(n, k) + xlny(k, p) + xlny(n - k, q);
 }
 
-static double Euh_log(unsigned t, unsigned i) {
-    return lnbino(INDEX * BLOCK_WEIGHT, i) +
-           lnbino(INDEX * (BLOCK_LENGTH - BLOCK_WEIGHT), t - i) -
-           lnbino(INDEX * BLOCK_LENGTH, t);
+static double Euh_log(parameters_t params, unsigned t, unsigned i) {
+    index_t n = params->index * params->block_length;
+    index_t w = params->index * params->block_weight;
+    return lnbino(w, i) + lnbino(n - w, t - i) - lnbino(n, t);
 }
 
 /* iks = X = sum((l - 1) * E_l, l odd) */
-static double iks(unsigned t) {
+static double iks(parameters_t params, unsigned t) {
     unsigned i;
     double x;
     double denom = 0.;
@@ -66,8 +70,8 @@ static double iks(unsigned t) {
     /* Euh_log(n, w, t, i) decreases fast when 'i' varies.
      For i >= 10 it is very likely to be negligible. */
     for (x = 0, i = 1; (i < 10) && (i < t); i += 2) {
-        x += (i - 1) * exp(Euh_log(t, i));
-        denom += exp(Euh_log(t, i));
+        x += (i - 1) * exp(Euh_log(params, t, i));
+        denom += exp(Euh_log(params, t, i));
     }
 
     if (denom == 0.)
@@ -77,50 +81,163 @@ static double iks(unsigned t) {
 
 /* Probability for a bit of the syndrome to be zero, knowing the syndrome
  * weight 'S' and 'X'. */
-static double counters_C0(unsigned S, unsigned t, double x) {
-    return ((INDEX * BLOCK_WEIGHT - 1) * S - x) / (INDEX * BLOCK_LENGTH - t) /
-           BLOCK_WEIGHT;
+static double counters_C0(parameters_t params, unsigned S, unsigned t,
+                          double x) {
+    return ((params->index * params->block_weight - 1) * S - x) /
+           (params->index * params->block_length - t) / params->block_weight;
 }
 
 /* Probability for a bit of the syndrome to be non-zero, knowing the syndrome
  * weight 'S' and 'X'. */
-static double counters_C1(unsigned S, unsigned t, double x) {
-    return (S + x) / t / BLOCK_WEIGHT;
+static double counters_C1(parameters_t params, unsigned S, unsigned t,
+                          double x) {
+    return (S + x) / t / params->block_weight;
 }
 
-unsigned compute_threshold(unsigned S, unsigned t) {
+unsigned compute_threshold(parameters_t params, unsigned S, unsigned t) {
+    const unsigned block_weight = params->block_weight;
+    const index_t n = params->index * params->block_length;
     double p, q;
 
-    double x = iks(t) * S;
-    p = counters_C0(S, t, x);
-    q = counters_C1(S, t, x);
+    double x = iks(params, t) * S;
+    p = counters_C0(params, S, t, x);
+    q = counters_C1(params, S, t, x);
 
     unsigned threshold;
     if (p >= 1.0 || p > q) {
-        threshold = BLOCK_WEIGHT;
+        threshold = block_weight;
     }
     else if (q >= 1.) {
-        threshold = BLOCK_WEIGHT + 1;
+        threshold = block_weight + 1;
         double diff = 0.;
         do {
             threshold--;
-            diff = -exp(lnbinomialpmf(BLOCK_WEIGHT, threshold, p, 1. - p)) *
-                       (INDEX * BLOCK_LENGTH - t) +
+            diff = -exp(lnbinomialpmf(block_weight, threshold, p, 1. - p)) *
+                       (n - t) +
                    1.;
-        } while (diff >= 0. && threshold > (BLOCK_WEIGHT + 1) / 2);
-        threshold = threshold < BLOCK_WEIGHT ? (threshold + 1) : BLOCK_WEIGHT;
+        } while (diff >= 0. && threshold > (block_weight + 1) / 2);
+        threshold = threshold < block_weight ? (threshold + 1) : block_weight;
     }
     else {
-        threshold = BLOCK_WEIGHT + 1;
+        threshold = block_weight + 1;
         double diff = 0.;
         do {
             threshold--;
-            diff = (-exp(lnbinomialpmf(BLOCK_WEIGHT, threshold, p, 1. - p)) *
-                        (INDEX * BLOCK_LENGTH - t) +
-                    exp(lnbinomialpmf(BLOCK_WEIGHT, threshold, q, 1. - q)) * t);
-        } while (diff >= 0. && threshold > (BLOCK_WEIGHT + 1) / 2);
-        threshold = threshold < BLOCK_WEIGHT ? (threshold + 1) : BLOCK_WEIGHT;
+            diff = (-exp(lnbinomialpmf(block_weight, threshold, p, 1. - p)) *
+                        (n - t) +
+                    exp(lnbinomialpmf(block_weight, threshold, q, 1. - q)) * t);
+        } while (diff >= 0. && threshold > (block_weight + 1) / 2);
+        threshold = threshold < block_weight ? (threshold + 1) : block_weight;
     }
 
     return threshold;
 }
+
+/* Header of a threshold table file, followed by the entries. */
+#define THRESHOLD_MAGIC "QCMDPCT2"
+struct threshold_header {
+    char magic[8];
+    int64_t index;
+    int64_t block_length;
+    int64_t block_weight;
+    int64_t error_weight;
+};
+
+static size_t threshold_table_size(threshold_table_t table) {
+    return (size_t)table->params.error_weight *
+           (table->params.block_length + 1);
+}
+
+static void threshold_header(threshold_table_t table,
+                             struct threshold_header *header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, THRESHOLD_MAGIC, sizeof(header->magic));
+    header->index = table->params.index;
+    header->block_length = table->params.block_length;
+    header->block_weight = table->params.block_weight;
+    header->error_weight = table->params.error_weight;
+}
+
+threshold_table_t threshold_table_new(parameters_t params) {
+    threshold_table_t table = malloc(sizeof(struct threshold_table));
+    table->params = *params;
+    /* Pages of entries that are never needed are never touched. */
+    table->values = calloc(threshold_table_size(table), sizeof(counter_t));
+    return table;
+}
+
+void threshold_table_free(threshold_table_t table) {
+    free(table->values);
+    free(table);
+}
+
+/* Compute all the missing entries. */
+void threshold_table_fill(threshold_table_t table, int n_threads) {
+    const index_t block_length = table->params.block_length;
+
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+    for (index_t t = 1; t <= table->params.error_weight; ++t) {
+        for (index_t S = 0; S <= block_length; ++S) {
+            threshold_table_get(table, S, t);
+        }
+    }
+}
+
+/* Merge the entries stored in 'path' into the table. Returns 1 on success, 0
+ * if the file does not exist and -1 if it is invalid or if it was computed
+ * for other parameters. */
+int threshold_table_load(threshold_table_t table, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    struct threshold_header expected, header;
+    threshold_header(table, &expected);
+    size_t size = threshold_table_size(table);
+    counter_t *values = malloc(size * sizeof(counter_t));
+    int ret = -1;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(&header, &expected, sizeof(header)) ||
+        fread(values, sizeof(counter_t), size, fp) != size)
+        goto end;
+
+    /* Check a sample of the computed entries against the current
+     * function. */
+    size_t n_computed = 0;
+    for (size_t i = 0; i < size; ++i) {
+        n_computed += !!values[i];
+    }
+    size_t step = n_computed / 1024 + 1;
+    for (size_t i = 0, n = 0; i < size; ++i) {
+        if (!values[i] || n++ % step)
+            continue;
+        unsigned t = i / (table->params.block_length + 1) + 1;
+        unsigned S = i % (table->params.block_length + 1);
+        if (values[i] != compute_threshold(&table->params, S, t))
+            goto end;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (values[i])
+            table->values[i] = values[i];
+    }
+    ret = 1;
+
+end:
+    free(values);
+    fclose(fp);
+    return ret;
+}
+
+/* Returns 1 on success, 0 otherwise. */
+int threshold_table_save(threshold_table_t table, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return 0;
+
+    struct threshold_header header;
+    threshold_header(table, &header);
+    size_t size = threshold_table_size(table);
+    int ret = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(table->values, sizeof(counter_t), size, fp) == size;
+    return fclose(fp) == 0 && ret;
+}
@@ -21,5 +21,35 @@
 */
 #ifndef THRESHOLD_H
 #define THRESHOLD_H
-unsigned compute_threshold(unsigned S, unsigned t);
+#include "types.h"
+
+unsigned compute_threshold(parameters_t params, unsigned S, unsigned t);
+
+/* Thresholds for all syndrome weights 'S' (up to BLOCK_LENGTH) and error
+ * weights 't' (from 1 to ERROR_WEIGHT). Entries are 0 until computed, which
+ * is done either all at once or the first time they are needed. */
+struct threshold_table {
+    struct parameters params;
+    counter_t *values;
+};
+
+threshold_table_t threshold_table_new(parameters_t params);
+void threshold_table_free(threshold_table_t table);
+void threshold_table_fill(threshold_table_t table, int n_threads);
+int threshold_table_load(threshold_table_t table, const char *path);
+int threshold_table_save(threshold_table_t table, const char *path);
+
+static inline unsigned threshold_table_get(threshold_table_t table, unsigned S,
+                                           unsigned t) {
+    counter_t *entry =
+        table->values + (size_t)(t - 1) * (table->params.block_length + 1) + S;
+    /* Entries may be filled concurrently by several threads, they all write
+     * the same value. */
+    unsigned threshold = __atomic_load_n(entry, __ATOMIC_RELAXED);
+    if (!threshold) {
+        threshold = compute_threshold(&table->params, S, t);
+        __atomic_store_n(entry, threshold, __ATOMIC_RELAXED);
+    }
+    return threshold;
+}
 #endif
@@ -23,9 +23,17 @@
 #define TYPES_H
 #include <stdint.h>
 
-/* Round relevant arrays size to the next multiple of 16 * 256 bits (to use the
- * 16 ymm AVX registers). */
-#define AVX_PADDING(len) ((len + (256 * 16) - 1) / (256 * 16)) * (256 * 16)
+/* Round relevant arrays size to the next multiple of 16 * 512 bits (to use
+ * 16 zmm AVX-512 registers, or twice the 16 ymm AVX registers). */
+#define AVX_PADDING(len) ((len + (512 * 16) - 1) / (512 * 16)) * (512 * 16)
+
+/* Number of bytes to allocate for a vector of 'len' bytes read or written by
+ * the vector kernels (with an extra padding block for reads past the end). */
+#define DENSE_LENGTH(len) (AVX_PADDING(8 * (len)) / 8 + AVX_PADDING(1) / 8)
+
+/* Functions instantiated several times with different constant arguments or
+ * target attributes. */
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
 typedef int_fast32_t index_t;
 typedef index_t *sparse_t;
@@ -33,31 +41,139 @@ typedef index_t *sparse_t;
 typedef uint8_t bit_t;
 typedef bit_t *dense_t;
 
+/* Counters are stored in 'bit_t' lanes when the block weight is at most 255,
+ * in 'counter_t' lanes otherwise. */
+typedef uint16_t counter_t;
+typedef counter_t *wide_t;
+#define MAX_NARROW_WEIGHT 255
+
+/* Packed representation: one bit per position, 64 positions per word. */
+typedef uint64_t word_t;
+typedef word_t *packed_t;
+#define WORD_BITS 64
+
+/* Number of words to allocate for a packed vector of 'len' bits, with enough
+ * slack for the kernels to read whole blocks past the end. */
+#define PACKED_LENGTH(len) (AVX_PADDING((len) + 32 * WORD_BITS) / WORD_BITS)
+
+/* Batch decoding: bit 'b' of each word of a lanes_t vector belongs to the
+ * instance 'b' of the batch. */
+#define BATCH_WORDS 8
+#define BATCH_LANES (BATCH_WORDS * WORD_BITS)
+typedef word_t lanes_t __attribute__((vector_size(BATCH_WORDS * 8)));
+
 typedef struct ring_buffer *ring_buffer_t;
 typedef struct flip_list *fl_t;
 typedef struct parameters *parameters_t;
 typedef struct decoder *decoder_t;
+typedef struct batch_decoder *batch_decoder_t;
+typedef struct threshold_table *threshold_table_t;
+typedef const struct kernels *kernels_t;
 
-/* Double linked list to store previous flips */
+/* Code and decoder parameters */
+struct parameters {
+    index_t index;
+    index_t block_length;
+    index_t block_weight;
+    index_t error_weight;
+    int ouroboros;
+    /* Syndrome weight at which decoding stops (non zero for Ouroboros) */
+    index_t syndrome_stop;
+    double ttl_coeff0;
+    double ttl_coeff1;
+    int ttl_saturate;
+    /* If not NULL, ttl of a flip whose counter is 'diff' above the threshold
+     * (the last value for larger differences) instead of the affine
+     * function */
+    const uint8_t *ttl_table;
+    index_t ttl_table_length;
+};
+
+/* Timing wheel of the previous flips: bucket 'b' holds, in any order, the
+ * flipped positions whose time of death is 'b' */
 struct flip_list {
-    index_t first;
+    index_t **buckets;
+    index_t *bucket_length;
+    index_t *bucket_capacity;
+    /* Time of death of each flipped position, and its index in the bucket */
     uint8_t *tod;
-    index_t *prev;
-    index_t *next;
+    index_t *slot;
     index_t length;
 };
 
 /* State of the decoder */
 struct decoder {
+    struct parameters params;
     sparse_t *Hcolumns;
     sparse_t *Hrows;
+#ifndef PACKED
     dense_t *bits;
     dense_t syndrome;
     dense_t *e;
+    /* Syndrome of the instance, to decode it again with restart_decoder */
+    dense_t initial_syndrome;
+#else
+    packed_t *bits;
+    packed_t syndrome;
+    packed_t *e;
+    packed_t initial_syndrome;
+#endif
+    index_t initial_syndrome_weight;
+#ifndef PACKED
+    /* Counters of each block, in 'wide_counters' if 'wide' */
+    int wide;
     bit_t **counters;
+    wide_t *wide_counters;
+    /* In incremental mode, the counters are kept up to date when the
+     * syndrome changes instead of being recomputed at each iteration, as
+     * long as there are at most 'max_incremental_flips' flips in between. */
+    int incremental;
+    int counters_valid;
+    index_t incremental_flips;
+    index_t max_incremental_flips;
+#endif
+    /* Positions (k * block_length + j) whose counter reached the threshold,
+     * and the value of that counter */
+    index_t *candidates;
+    counter_t *candidate_counters;
+    index_t n_candidates;
+    kernels_t kernels;
+    /* Bitmap to draw the blocks of the key and the syndrome error */
+    packed_t sample_bitmap;
+    /* Number of threads decoding this instance, and number of candidates
+     * found in each range of positions when it is more than 1 */
+    int threads;
+    index_t *chunk_candidates;
+    /* Thresholds shared between decoders, computed on the fly if NULL */
+    threshold_table_t thresholds;
+    /* ttl of a flip depending on how much its counter is above the
+     * threshold */
+    uint8_t *ttl;
     fl_t fl;
     index_t syndrome_weight;
     // index_t error_weight;
     index_t iter;
 };
-#endif
+/* State of a batch of BATCH_LANES decoders sharing the same parity check
+ * matrix and run in lockstep */
+struct batch_decoder {
+    struct parameters params;
+    sparse_t *Hcolumns;
+    /* Syndromes, duplicated so that rotations are contiguous */
+    lanes_t *syndrome;
+    /* Decisions, lanes flipped at the current iteration and time of death
+     * of the flips (as bit planes) of each block */
+    lanes_t **bits;
+    lanes_t **flips;
+    lanes_t **tod;
+    int tod_planes;
+    /* ttl of a flip depending on how much its counter is above the
+     * threshold */
+    uint8_t *ttl;
+    threshold_table_t thresholds;
+    index_t syndrome_weight[BATCH_LANES];
+    index_t n_flipped[BATCH_LANES];
+    unsigned threshold[BATCH_LANES];
+    int iter[BATCH_LANES];
+};
+#endif
\ No newline at end of file
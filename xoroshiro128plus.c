@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "xoroshiro128plus.h"
 
@@ -63,27 +64,57 @@ int seed_random(uint64_t *S0, uint64_t *S1) {
     return 1;
 }
 
-uint64_t random_lim(uint64_t limit, uint64_t *S0, uint64_t *S1) {
-    uint64_t divisor = 0xffffffffffffffffUL / (limit + 1);
-    uint64_t retval;
+/* Expand a 64-bit seed into a state with splitmix64, as suggested above. */
+
+void seed_splitmix64(uint64_t seed, uint64_t *S0, uint64_t *S1) {
+    uint64_t s[2];
+    for (int i = 0; i < 2; ++i) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        s[i] = z ^ (z >> 31);
+    }
+    *S0 = s[0];
+    *S1 = s[1];
+}
 
-    do {
-        retval = random_uint64_t(S0, S1) / divisor;
-    } while (retval > limit);
+/* Characteristic polynomial of the transition of the generator without its
+   leading term x^128: bit b of CHARPOLY is the coefficient of degree b. */
 
-    return retval;
-}
+static const uint64_t CHARPOLY[2] = {0x095b8f76579aa001, 0x0008828e513b43d5};
 
-/* This is the jump function for the generator. It is equivalent
-   to 2^64 calls to next(); it can be used to generate 2^64
-   non-overlapping subsequences for parallel computations. */
+/* R = A * B modulo the characteristic polynomial (R may be A or B). */
 
-void jump(uint64_t *S0, uint64_t *S1) {
-    static const uint64_t JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+static void poly_mulmod(const uint64_t A[2], const uint64_t B[2],
+                        uint64_t R[2]) {
+    uint64_t a0 = A[0], a1 = A[1];
+    uint64_t r0 = 0, r1 = 0;
+    for (int i = 0; i < 2; i++)
+        for (int b = 0; b < 64; b++) {
+            if (B[i] & UINT64_C(1) << b) {
+                r0 ^= a0;
+                r1 ^= a1;
+            }
+            const uint64_t carry = a1 >> 63;
+            a1 = a1 << 1 | a0 >> 63;
+            a0 <<= 1;
+            if (carry) {
+                a0 ^= CHARPOLY[0];
+                a1 ^= CHARPOLY[1];
+            }
+        }
+
+    R[0] = r0;
+    R[1] = r1;
+}
 
+/* Replace the state by J(M) applied to it, where M is the transition of the
+   generator and bit b of JUMP is the coefficient of degree b of J. */
+
+static void jump_poly(const uint64_t JUMP[2], uint64_t *S0, uint64_t *S1) {
     uint64_t s0 = 0;
     uint64_t s1 = 0;
-    for (int i = 0; i < sizeof(JUMP) / sizeof(*JUMP); i++)
+    for (int i = 0; i < 2; i++)
         for (int b = 0; b < 64; b++) {
             if (JUMP[i] & UINT64_C(1) << b) {
                 s0 ^= *S0;
@@ -95,3 +126,84 @@ void jump(uint64_t *S0, uint64_t *S1) {
     *S0 = s0;
     *S1 = s1;
 }
+
+/* This is the jump function for the generator. It is equivalent
+   to 2^64 calls to next(); it can be used to generate 2^64
+   non-overlapping subsequences for parallel computations. */
+
+void jump(uint64_t *S0, uint64_t *S1) {
+    static const uint64_t JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+    jump_poly(JUMP, S0, S1);
+}
+
+/* This is the long-jump function for the generator. It is equivalent to
+   2^96 calls to next(); it can be used to generate 2^32 starting points,
+   from each of which jump() will generate 2^32 non-overlapping
+   subsequences for parallel distributed computations. */
+
+void long_jump(uint64_t *S0, uint64_t *S1) {
+    static const uint64_t JUMP[] = {0xd2a98b26625eee7b, 0xdddf9b1090aa7ac1};
+    jump_poly(JUMP, S0, S1);
+}
+
+/* Equivalent to 2^48 calls to next(): it separates the lanes of a PRNG, each
+   of which can then draw 2^48 values before running into the next one, all
+   within the 2^64 values between two jumps. (The polynomial is x^(2^48)
+   modulo the characteristic polynomial of the generator.) */
+
+void short_jump(uint64_t *S0, uint64_t *S1) {
+    static const uint64_t JUMP[] = {0xd769cfc9028deb78, 0x9b19ba6b3752065a};
+    jump_poly(JUMP, S0, S1);
+}
+
+/* Equivalent to n * 2^51 calls to next(), that is to n times the values of
+   the PRNG_LANES lanes of a PRNG: substream 'n' of a stream is the one of the
+   n-th PRNG started from it. The polynomial x^(n * 2^51) is computed by
+   square and multiply from x^(2^51), in O(log n). */
+
+void substream_jump(uint64_t n, uint64_t *S0, uint64_t *S1) {
+    uint64_t power[2] = {0x3ae9471d0e2d0bcf, 0xaaae579366147d07};
+    uint64_t poly[2] = {1, 0};
+    for (;;) {
+        if (n & 1)
+            poly_mulmod(poly, power, poly);
+        if (!(n >>= 1))
+            break;
+        poly_mulmod(power, power, power);
+    }
+    jump_poly(poly, S0, S1);
+}
+
+void prng_init(prng_t prng, uint64_t s0, uint64_t s1) {
+    for (int l = 0; l < PRNG_LANES; ++l) {
+        prng->s0[l] = s0;
+        prng->s1[l] = s1;
+        short_jump(&s0, &s1);
+    }
+    prng->next = PRNG_BUFFER;
+}
+
+/* Advance all the lanes at once, the compiler turns each operation on a
+   prng_vector_t into one or a few SIMD instructions. Values are stored lane
+   by lane: buffer[i * PRNG_LANES + l] is the i-th output of lane l. */
+
+typedef uint64_t prng_vector_t __attribute__((vector_size(PRNG_LANES * 8)));
+
+void prng_refill(prng_t prng) {
+    prng_vector_t s0, s1;
+    memcpy(&s0, prng->s0, sizeof(s0));
+    memcpy(&s1, prng->s1, sizeof(s1));
+
+    for (int i = 0; i < PRNG_BUFFER; i += PRNG_LANES) {
+        const prng_vector_t result = s0 + s1;
+        memcpy(&prng->buffer[i], &result, sizeof(result));
+
+        s1 ^= s0;
+        s0 = ((s0 << 24) | (s0 >> 40)) ^ s1 ^ (s1 << 16);
+        s1 = (s1 << 37) | (s1 >> 27);
+    }
+
+    memcpy(prng->s0, &s0, sizeof(s0));
+    memcpy(prng->s1, &s1, sizeof(s1));
+    prng->next = 0;
+}
@@ -4,15 +4,51 @@
 
 uint64_t random_uint64_t(uint64_t *S0, uint64_t *S1);
 int seed_random(uint64_t *S0, uint64_t *S1);
-uint64_t random_lim(uint64_t limit, uint64_t *S0, uint64_t *S1);
+void seed_splitmix64(uint64_t seed, uint64_t *S0, uint64_t *S1);
 void jump(uint64_t *S0, uint64_t *S1);
+void long_jump(uint64_t *S0, uint64_t *S1);
+void short_jump(uint64_t *S0, uint64_t *S1);
+void substream_jump(uint64_t n, uint64_t *S0, uint64_t *S1);
+
+/* A PRNG runs PRNG_LANES xoroshiro128+ streams side by side, lane 'l' starting
+ * 'l' short jumps after the seed, and hands out their outputs from a buffer
+ * refilled PRNG_BUFFER values at a time. */
+#define PRNG_LANES 8
+#define PRNG_BUFFER (16 * PRNG_LANES)
 
 struct PRNG {
-    uint64_t s0;
-    uint64_t s1;
-    uint64_t (*random_lim)(uint64_t limit, uint64_t *s0, uint64_t *s1);
-    uint64_t (*random_uint64_t)(uint64_t *s0, uint64_t *s1);
+    uint64_t s0[PRNG_LANES];
+    uint64_t s1[PRNG_LANES];
+    uint64_t buffer[PRNG_BUFFER];
+    int next;
 };
 
 typedef struct PRNG *prng_t;
+
+void prng_init(prng_t prng, uint64_t s0, uint64_t s1);
+void prng_refill(prng_t prng);
+
+static inline uint64_t prng_uint64_t(prng_t prng) {
+    if (prng->next == PRNG_BUFFER)
+        prng_refill(prng);
+    return prng->buffer[prng->next++];
+}
+
+/* Uniform integer in [0, limit]. The high half of a 64x64-bit product is
+ * unbiased once the low half is at least 2^64 mod (limit + 1); that remainder
+ * is only computed when the low half is small enough to possibly be below
+ * it, so there is almost never a division (D. Lemire, "Fast random integer
+ * generation in an interval", 2019). */
+static inline uint64_t prng_lim(prng_t prng, uint64_t limit) {
+    uint64_t range = limit + 1;
+    if (range == 0)
+        return prng_uint64_t(prng);
+    unsigned __int128 m = (unsigned __int128)prng_uint64_t(prng) * range;
+    if ((uint64_t)m < range) {
+        uint64_t min_low = -range % range;
+        while ((uint64_t)m < min_low)
+            m = (unsigned __int128)prng_uint64_t(prng) * range;
+    }
+    return m >> 64;
+}
 #endif